@@ -0,0 +1,329 @@
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#include "dmem.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+Allocator benchmarks.
+
+Every case is run once per allocator, in a process of its own, for the peak
+resident set size to be that of the case alone. Results are written to stdout
+as CSV, with one line per case and allocator:
+
+    case,allocator,ops,ns_per_op,ops_per_s,peak_rss_kb
+
+An operation is one allocation, including its share of the cost of freeing or
+resetting. The amount of rounds run may be given as the only argument. The
+threaded case gives every thread an allocator of its own, while the shared case
+has all threads allocate from the same one at once.
+*/
+
+#define OBJECTS 10000
+#define THREADS 4
+#define BLOCK_SIZE (64 * 1024)
+
+typedef struct {
+    const char *name;
+    size_t (*size)(size_t i);
+    size_t objects, repeat; // Objects per round, and rounds per round run.
+} pattern_t;
+
+typedef struct {
+    const char *name;
+    void *(*create)(void);
+    void *(*alloc)(void *a, size_t size);
+    void *(*alloc_concurrent)(void *a, size_t size);
+    void (*release)(void *a, void **ptrs, size_t n);
+    void (*destroy)(void *a);
+} allocator_t;
+
+typedef struct {
+    const pattern_t *p;
+    const allocator_t *a;
+    size_t rounds;
+    void *x;     // Allocator shared with other threads, if any.
+    void **ptrs; // Objects allocated from the shared allocator.
+} run_t;
+
+// Keeps the objects allocated from being optimized away.
+static _Atomic unsigned char sink;
+
+static size_t size_tiny(size_t i)
+{
+    (void) i;
+    return 16;
+}
+
+static size_t size_mixed(size_t i)
+{
+    // Mostly small sizes, with an occasional larger one.
+    const uint32_t x = (uint32_t) i * 2654435761u;
+    return (x >> 28) < 14 ? 8 + (x >> 20 & 0xff) : 1024 + (x >> 16 & 0xfff);
+}
+
+static size_t size_oversize(size_t i)
+{
+    return BLOCK_SIZE + (i % 4) * 4096;
+}
+
+static void *dmem_bench_create(void)
+{
+    dmem_t *m = dmem_create(BLOCK_SIZE);
+    if (m != NULL) {
+        dmem_retain(m, 4 * BLOCK_SIZE);
+    }
+    return m;
+}
+
+static void *dmem_bench_alloc(void *a, size_t size)
+{
+    return dmem_alloc(a, size);
+}
+
+static void *dmem_bench_alloc_concurrent(void *a, size_t size)
+{
+    return dmem_alloc_concurrent(a, size);
+}
+
+static void dmem_bench_release(void *a, void **ptrs, size_t n)
+{
+    (void) ptrs;
+    (void) n;
+    dmem_reset(a);
+}
+
+static void dmem_bench_destroy(void *a)
+{
+    dmem_destroy(a);
+}
+
+static void *malloc_bench_create(void)
+{
+    static int heap;
+    return &heap;
+}
+
+static void *malloc_bench_alloc(void *a, size_t size)
+{
+    (void) a;
+    return malloc(size);
+}
+
+static void malloc_bench_release(void *a, void **ptrs, size_t n)
+{
+    (void) a;
+    for (size_t i = 0; i < n; ++i) {
+        free(ptrs[i]);
+    }
+}
+
+static void malloc_bench_destroy(void *a)
+{
+    (void) a;
+}
+
+static const allocator_t allocators[] = {
+    {"dmem", dmem_bench_create, dmem_bench_alloc, dmem_bench_alloc_concurrent,
+        dmem_bench_release, dmem_bench_destroy},
+    {"malloc", malloc_bench_create, malloc_bench_alloc, malloc_bench_alloc,
+        malloc_bench_release, malloc_bench_destroy},
+};
+
+static const pattern_t patterns[] = {
+    {"tiny", size_tiny, OBJECTS, 1},
+    {"mixed", size_mixed, OBJECTS, 1},
+    {"oversize", size_oversize, 64, 1},
+    {"reset", size_tiny, 100, 100},
+};
+
+/*
+Runs pattern the given amount of rounds, each allocating all objects of the
+pattern and then releasing them. Returns the number of operations done.
+*/
+static size_t run_pattern(const pattern_t *p, const allocator_t *a,
+                          size_t rounds)
+{
+    void **ptrs = malloc(p->objects * sizeof(void *));
+    void *x = a->create();
+    if (ptrs == NULL || x == NULL) {
+        fprintf(stderr, "%s: out of memory\n", p->name);
+        exit(1);
+    }
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < p->objects; ++i) {
+            unsigned char *v = a->alloc(x, p->size(i));
+            if (v == NULL) {
+                fprintf(stderr, "%s: out of memory\n", p->name);
+                exit(1);
+            }
+            *v = (unsigned char) i;
+            ptrs[i] = v;
+        }
+        atomic_store_explicit(&sink, *(unsigned char *) ptrs[p->objects - 1],
+                              memory_order_relaxed);
+        a->release(x, ptrs, p->objects);
+    }
+    a->destroy(x);
+    free(ptrs);
+    return rounds * p->objects;
+}
+
+static void *run_thread(void *arg)
+{
+    run_t *run = arg;
+    run_pattern(run->p, run->a, run->rounds);
+    return NULL;
+}
+
+/*
+Allocates all objects of one round of the pattern from the shared allocator.
+*/
+static void *run_shared_thread(void *arg)
+{
+    run_t *run = arg;
+    for (size_t i = 0; i < run->p->objects; ++i) {
+        unsigned char *v = run->a->alloc_concurrent(run->x, run->p->size(i));
+        if (v == NULL) {
+            fprintf(stderr, "%s: out of memory\n", run->p->name);
+            exit(1);
+        }
+        *v = (unsigned char) i;
+        run->ptrs[i] = v;
+    }
+    return NULL;
+}
+
+/*
+Runs f with each of the THREADS runs in a thread of its own, and waits for all
+of them to finish.
+*/
+static void join_threads(void *(*f)(void *), run_t *runs)
+{
+    pthread_t threads[THREADS];
+    for (size_t i = 0; i < THREADS; ++i) {
+        const int error = pthread_create(&threads[i], NULL, f, &runs[i]);
+        if (error != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+static size_t run_threads(const pattern_t *p, const allocator_t *a,
+                          size_t rounds)
+{
+    run_t runs[THREADS];
+    for (size_t i = 0; i < THREADS; ++i) {
+        runs[i] = (run_t) {p, a, rounds, NULL, NULL};
+    }
+    join_threads(run_thread, runs);
+    return THREADS * rounds * p->objects;
+}
+
+/*
+Runs pattern in all threads at once, allocating from the same allocator. The
+objects of all threads are released together after each round, which requires
+the threads to be joined and started again.
+*/
+static size_t run_shared(const pattern_t *p, const allocator_t *a,
+                         size_t rounds)
+{
+    void **ptrs = malloc(THREADS * p->objects * sizeof(void *));
+    void *x = a->create();
+    if (ptrs == NULL || x == NULL) {
+        fprintf(stderr, "%s: out of memory\n", p->name);
+        exit(1);
+    }
+    run_t runs[THREADS];
+    for (size_t i = 0; i < THREADS; ++i) {
+        runs[i] = (run_t) {p, a, 1, x, &ptrs[i * p->objects]};
+    }
+    for (size_t r = 0; r < rounds; ++r) {
+        join_threads(run_shared_thread, runs);
+        const unsigned char *last = ptrs[THREADS * p->objects - 1];
+        atomic_store_explicit(&sink, *last, memory_order_relaxed);
+        a->release(x, ptrs, THREADS * p->objects);
+    }
+    a->destroy(x);
+    free(ptrs);
+    return THREADS * rounds * p->objects;
+}
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static long peak_rss_kb(void)
+{
+    struct rusage u;
+    getrusage(RUSAGE_SELF, &u);
+#ifdef __APPLE__
+    return u.ru_maxrss / 1024;
+#else
+    return u.ru_maxrss;
+#endif
+}
+
+static void bench(const char *name, const pattern_t *p, const allocator_t *a,
+                  size_t rounds,
+                  size_t (*run)(const pattern_t *p, const allocator_t *a,
+                                size_t rounds))
+{
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid != 0) {
+        int status;
+        waitpid(pid, &status, 0);
+        return;
+    }
+
+    const double start = now();
+    const size_t ops = run(p, a, rounds);
+    const double ns = now() - start;
+
+    printf("%s,%s,%zu,%.2f,%.0f,%ld\n", name, a->name, ops, ns / ops,
+           ops / ns * 1e9, peak_rss_kb());
+    fflush(stdout);
+    _exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : 100;
+    const size_t n = sizeof(allocators) / sizeof(allocators[0]);
+
+    printf("case,allocator,ops,ns_per_op,ops_per_s,peak_rss_kb\n");
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); ++i) {
+        const pattern_t *p = &patterns[i];
+        for (size_t j = 0; j < n; ++j) {
+            bench(p->name, p, &allocators[j], rounds * p->repeat,
+                  run_pattern);
+        }
+    }
+    for (size_t j = 0; j < n; ++j) {
+        bench("threaded", &patterns[0], &allocators[j], rounds, run_threads);
+    }
+    for (size_t j = 0; j < n; ++j) {
+        bench("shared", &patterns[0], &allocators[j], rounds, run_shared);
+    }
+    return 0;
+}
@@ -1,7 +1,61 @@
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
 #include "dmem.h"
 
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#endif
+
+#define _HUGE_PAGE_SIZE ((size_t) 2 << 20)
+
+#ifdef DMEM_STATS
+#define _STAT(m, statement) ((m)->stats.statement)
+
+static void _stat_footprint(dmem_t *m, const size_t grown)
+{
+    m->stats.footprint += grown;
+    if (m->stats.peak < m->stats.footprint) {
+        m->stats.peak = m->stats.footprint;
+    }
+}
+
+/*
+Counts block of given capacity added by a concurrent allocation.
+*/
+static void _stat_block_concurrent(dmem_t *m, const size_t grown)
+{
+    __atomic_add_fetch(&m->stats.blocks, 1, __ATOMIC_RELAXED);
+    const size_t footprint = __atomic_add_fetch(&m->stats.footprint, grown,
+                                                __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&m->stats.peak, __ATOMIC_RELAXED);
+    while (peak < footprint && !__atomic_compare_exchange_n(
+                &m->stats.peak, &peak, footprint, 1,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+#else
+#define _STAT(m, statement)
+#define _stat_footprint(m, grown)
+#define _stat_block_concurrent(m, grown)
+#endif
+
 #if defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200112L
-void *_alloc(size_t size)
+static void *_alloc(size_t size)
 {
     void *result = NULL;
     if (posix_memalign(&result, DMEM_ALIGNMENT, size) != 0) {
@@ -15,86 +69,298 @@ void *_alloc(size_t size)
 #error "Build with >= POSIX.1d, or C11 support."
 #endif
 
-size_t _align(const size_t n)
-{
-    return (n & (DMEM_ALIGNMENT - 1))
-           ? (n & ~(DMEM_ALIGNMENT - 1)) + DMEM_ALIGNMENT
-           : n;
-}
+_Static_assert((DMEM_ALIGNMENT & (DMEM_ALIGNMENT - 1)) == 0,
+               "DMEM_ALIGNMENT must be a power of two.");
 
-dmem_block_t *_block_create(size_t block_size)
+static dmem_block_t *_block_create(size_t block_size)
 {
-    dmem_block_t *b = _alloc(sizeof(dmem_block_t) + _align(block_size));
+    dmem_block_t *b = _alloc(sizeof(dmem_block_t) + _dmem_align(block_size));
     if (b == NULL) {
         return NULL;
     }
     b->origin = (void *) &b[1];
     b->offset = b->origin;
     b->end = &b->origin[block_size];
+    b->zero = &b->origin[block_size];
+    b->mapped = 0;
     b->next = NULL;
 
     return b;
 }
 
+static dmem_block_t *_block_map(size_t block_size);
+
+static void _block_free(dmem_block_t *b)
+{
+#ifdef _MMAP
+    if (b->mapped != 0) {
+        munmap(b, b->mapped);
+        return;
+    }
+#endif
+    free(b);
+}
+
+static void _dmem_init(dmem_t *m, dmem_block_t *b, size_t block_size)
+{
+    m->blocks = b;
+    m->block_size = block_size;
+    m->spare = NULL;
+    m->retained = 0;
+    m->retain_limit = 0;
+    m->recycled.hits = 0;
+    m->recycled.misses = 0;
+    m->growth = 1;
+    m->block_size_max = block_size;
+    m->mmap_threshold = 0;
+    m->reserve = 0;
+    m->flags = 0;
+    m->marked = NULL;
+
+#ifdef DMEM_STATS
+    m->stats = (dmem_stats_t) {0};
+    m->stats.blocks = 1;
+    m->stats.footprint = b->end - b->origin;
+    m->stats.peak = m->stats.footprint;
+#endif
+}
+
 dmem_t *dmem_create(size_t block_size)
 {
-    block_size = _align(block_size);
+    block_size = _dmem_align(block_size);
     dmem_t *m = _alloc(sizeof(dmem_t));
     if (m == NULL) {
         return NULL;
     }
-    m->blocks = _block_create(block_size);
-    if (m->blocks == NULL) {
+    dmem_block_t *b = _block_create(block_size);
+    if (b == NULL) {
         free(m);
         return NULL;
     }
-    m->block_size = block_size;
+    _dmem_init(m, b, block_size);
     return m;
 }
 
-void dmem_destroy(dmem_t *m)
+static size_t _round(const size_t n, const size_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+#ifdef _MMAP
+static char *_reserve(const size_t size, const size_t alignment)
+{
+    // Over-reserving by the alignment and unmapping the excess at both ends
+    // is the only portable way of getting a range with a larger alignment
+    // than the page size.
+    char *p = mmap(NULL, size + alignment, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    char *origin = (char *) _round((uintptr_t) p, alignment);
+    if (origin != p) {
+        munmap(p, origin - p);
+    }
+    if (&origin[size] != &p[size + alignment]) {
+        munmap(&origin[size], &p[size + alignment] - &origin[size]);
+    }
+    return origin;
+}
+#endif
+
+static dmem_block_t *_block_map(size_t block_size)
+{
+#ifdef _MMAP
+    const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t size = _round(sizeof(dmem_block_t) + block_size, page);
+    dmem_block_t *b = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b == MAP_FAILED) {
+        return NULL;
+    }
+    // Fresh mappings are zeroed by the operating system.
+    b->origin = (void *) &b[1];
+    b->offset = b->origin;
+    b->end = &b->origin[block_size];
+    b->zero = b->origin;
+    b->mapped = size;
+    b->next = NULL;
+
+    return b;
+#else
+    return _block_create(block_size);
+#endif
+}
+
+dmem_t *dmem_create_reserved(size_t block_size, size_t reserve, int flags)
+{
+#ifdef _MMAP
+    const size_t page = (flags & DMEM_HUGE_PAGES)
+                        ? _HUGE_PAGE_SIZE
+                        : (size_t) sysconf(_SC_PAGESIZE);
+    if (reserve == 0) {
+        return NULL;
+    }
+    block_size = _round(block_size != 0 ? block_size : 1, page);
+    reserve = _round(reserve, page);
+
+    // The only block of the object is kept right after it.
+    dmem_t *m = _alloc(sizeof(dmem_t) + sizeof(dmem_block_t));
+    if (m == NULL) {
+        return NULL;
+    }
+    char *origin = _reserve(reserve, page);
+    if (origin == NULL) {
+        free(m);
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if (flags & DMEM_HUGE_PAGES) {
+        madvise(origin, reserve, MADV_HUGEPAGE);
+    }
+#endif
+    dmem_block_t *b = (void *) &m[1];
+    b->origin = origin;
+    b->offset = origin;
+    b->end = origin;
+    b->zero = origin;
+    b->mapped = 0;
+    b->next = NULL;
+
+    _dmem_init(m, b, block_size);
+    m->reserve = reserve;
+    m->flags = flags;
+    return m;
+#else
+    return NULL;
+#endif
+}
+
+static void _blocks_free(dmem_block_t *b)
 {
-    dmem_block_t *b = m->blocks;
     while (b != NULL) {
         dmem_block_t *next = b->next;
-        free(b);
+        _block_free(b);
         b = next;
     }
+}
+
+void dmem_destroy(dmem_t *m)
+{
+    if (m->reserve != 0) {
+#ifdef _MMAP
+        munmap(m->blocks->origin, m->reserve);
+#endif
+    } else {
+        _blocks_free(m->blocks);
+    }
+    _blocks_free(m->spare);
     free(m);
 }
 
-void *_single_block_alloc(dmem_t *m, const size_t size);
-void *_block_alloc(dmem_t *m, const size_t size);
+static size_t _block_capacity(const dmem_block_t *b)
+{
+    return b->end - b->origin;
+}
 
-void *dmem_alloc(dmem_t *m, size_t size)
+static dmem_block_t *_block_recycle(dmem_t *m, const size_t size)
 {
-    size = _align(size);
-    if (size > m->block_size / 2) {
+    for (dmem_block_t **p = &m->spare; *p != NULL; p = &(*p)->next) {
+        dmem_block_t *b = *p;
+        if (_block_capacity(b) >= size) {
+            *p = b->next;
+            b->next = NULL;
+            m->retained -= _block_capacity(b);
+            m->recycled.hits++;
+            return b;
+        }
+    }
+    m->recycled.misses++;
+    return NULL;
+}
+
+static void _block_rewind(dmem_block_t *b, char *offset)
+{
+    if (b->zero < b->offset) {
+        b->zero = b->offset;
+    }
+    b->offset = offset;
+}
+
+static void _block_release(dmem_t *m, dmem_block_t *b)
+{
+    _STAT(m, footprint -= _block_capacity(b));
+    if (b->mapped != 0 || m->retained + _block_capacity(b) > m->retain_limit) {
+        _block_free(b);
+        return;
+    }
+    _block_rewind(b, b->origin);
+    b->next = m->spare;
+    m->spare = b;
+    m->retained += _block_capacity(b);
+}
+
+static void *_single_block_alloc(dmem_t *m, const size_t size);
+static void *_block_alloc(dmem_t *m, const size_t size);
+
+void *_dmem_alloc(dmem_t *m, const size_t size)
+{
+    if (size > m->block_size / 2 && m->reserve == 0) {
         return _single_block_alloc(m, size);
     }
     return _block_alloc(m, size);
 }
 
-void *_single_block_alloc(dmem_t *m, const size_t size) {
-    dmem_block_t *b = _block_create(size);
+static int _block_mappable(const dmem_t *m, const size_t size)
+{
+    return m->mmap_threshold != 0 && size >= m->mmap_threshold;
+}
+
+static void *_single_block_alloc(dmem_t *m, const size_t size)
+{
+    dmem_block_t *b;
+    if (_block_mappable(m, size)) {
+        b = _block_map(size);
+    } else if ((b = _block_recycle(m, size)) == NULL) {
+        b = _block_create(size);
+    }
     if (b == NULL) {
         return NULL;
     }
+    _STAT(m, oversize++);
+    _STAT(m, blocks++);
+    _stat_footprint(m, _block_capacity(b));
+
+    b->offset = (char *) b->end;
     dmem_block_t *b0 = m->blocks->next;
     b->next = b0;
     m->blocks->next = b;
     return b->origin;
 }
 
-size_t _block_space_left(dmem_block_t *b);
+static size_t _block_space_left(dmem_block_t *b);
+static size_t _block_size_grow(dmem_t *m);
+static int _reserved_extend(dmem_t *m, const char *offset);
 
-void *_block_alloc(dmem_t *m, const size_t size)
+static void *_block_alloc(dmem_t *m, const size_t size)
 {
-    if (_block_space_left(m->blocks) < size) {
-        dmem_block_t *b = _block_create(m->block_size);
+    if (_block_space_left(m->blocks) < size && m->reserve != 0) {
+        if (_reserved_extend(m, &m->blocks->offset[size]) == -1) {
+            return NULL;
+        }
+
+    } else if (_block_space_left(m->blocks) < size) {
+        dmem_block_t *b = _block_recycle(m, size);
+        if (b == NULL) {
+            b = _block_create(_block_size_grow(m));
+        }
         if (b == NULL) {
             return NULL;
         }
+        _STAT(m, waste += _block_space_left(m->blocks));
+        _STAT(m, blocks++);
+        _stat_footprint(m, _block_capacity(b));
+
         b->next = m->blocks;
         m->blocks = b;
     }
@@ -105,19 +371,653 @@ void *_block_alloc(dmem_t *m, const size_t size)
     return a;
 }
 
-size_t _block_space_left(dmem_block_t *b)
+static size_t _block_space_left(dmem_block_t *b)
 {
     return b->end - b->offset;
 }
 
+static size_t _block_size_grow(dmem_t *m)
+{
+    if (m->block_size < m->block_size_max) {
+        const size_t size = m->block_size * m->growth;
+        const int overflow = size / m->growth != m->block_size;
+        m->block_size = (overflow || size > m->block_size_max)
+                        ? m->block_size_max
+                        : size;
+    }
+    return m->block_size;
+}
+
+static const char *_commit_end(const dmem_t *m, const char *offset);
+static int _commit(const char *end, const char *new_end);
+
+static int _reserved_extend(dmem_t *m, const char *offset)
+{
+    dmem_block_t *b = m->blocks;
+    const char *end = _commit_end(m, offset);
+    if (end == NULL || _commit(b->end, end) == -1) {
+        return -1;
+    }
+    _stat_footprint(m, end - b->end);
+    b->end = end;
+    return 0;
+}
+
+static const char *_commit_end(const dmem_t *m, const char *offset)
+{
+    const char *origin = m->blocks->origin;
+    if ((size_t) (offset - origin) > m->reserve) {
+        return NULL;
+    }
+#ifdef _MMAP
+    size_t size = _round(offset - origin, m->block_size);
+    return &origin[size < m->reserve ? size : m->reserve];
+#else
+    return NULL;
+#endif
+}
+
+static int _commit(const char *end, const char *new_end)
+{
+#ifdef _MMAP
+    if (mprotect((void *) end, new_end - end, PROT_READ | PROT_WRITE) != 0) {
+        return -1;
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+static void *_reserved_alloc_concurrent(dmem_t *m, const size_t size);
+static void *_single_block_alloc_concurrent(dmem_t *m, const size_t size);
+static void *_block_alloc_concurrent(dmem_t *m, const size_t size);
+
+void *dmem_alloc_concurrent(dmem_t *m, size_t size)
+{
+    size = _dmem_align(size);
+    if (m->reserve != 0) {
+        return _reserved_alloc_concurrent(m, size);
+    }
+    if (size > m->block_size / 2) {
+        return _single_block_alloc_concurrent(m, size);
+    }
+    return _block_alloc_concurrent(m, size);
+}
+
+static void *_reserved_alloc_concurrent(dmem_t *m, const size_t size)
+{
+    dmem_block_t *b = m->blocks;
+    const char *limit = &b->origin[m->reserve];
+    char *a = __atomic_load_n(&b->offset, __ATOMIC_RELAXED);
+    do {
+        if ((size_t) (limit - a) < size) {
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&b->offset, &a, a + size, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    // Each thread commits from the end it observed, which means that all
+    // memory below the end is committed whenever it is raised.
+    const char *end = __atomic_load_n(&b->end, __ATOMIC_ACQUIRE);
+    if (&a[size] > end) {
+        const char *new_end = _commit_end(m, &a[size]);
+        if (_commit(end, new_end) == -1) {
+            return NULL;
+        }
+        while (end < new_end && !__atomic_compare_exchange_n(
+                    &b->end, &end, new_end, 1,
+                    __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+    }
+    return a;
+}
+
+static void *_single_block_alloc_concurrent(dmem_t *m, const size_t size)
+{
+    dmem_block_t *b = _block_mappable(m, size)
+                      ? _block_map(size)
+                      : _block_create(size);
+    if (b == NULL) {
+        return NULL;
+    }
+    b->offset = (char *) b->end;
+    _stat_block_concurrent(m, _block_capacity(b));
+
+    // Heads replaced meanwhile still link to the observed head, so any block
+    // inserted behind it remains reachable.
+    dmem_block_t *head = __atomic_load_n(&m->blocks, __ATOMIC_ACQUIRE);
+    b->next = __atomic_load_n(&head->next, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&head->next, &b->next, b, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return b->origin;
+}
+
+static void *_block_alloc_concurrent(dmem_t *m, const size_t size)
+{
+    dmem_block_t *b = __atomic_load_n(&m->blocks, __ATOMIC_ACQUIRE);
+    dmem_block_t *c = NULL;
+    for (;;) {
+        char *a = __atomic_load_n(&b->offset, __ATOMIC_RELAXED);
+        while ((size_t) (b->end - a) >= size) {
+            if (__atomic_compare_exchange_n(&b->offset, &a, a + size, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                free(c);
+                return a;
+            }
+        }
+
+        // The head is full. A new block, with the requested memory already
+        // taken from it, is installed unless some other thread got there
+        // first, in which case the block is kept for the next attempt.
+        if (c == NULL) {
+            c = _block_create(m->block_size);
+            if (c == NULL) {
+                return NULL;
+            }
+            c->offset += size;
+        }
+        c->next = b;
+        if (__atomic_compare_exchange_n(&m->blocks, &b, c, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            _stat_block_concurrent(m, _block_capacity(c));
+            return c->origin;
+        }
+    }
+}
+
 void dmem_reset(dmem_t *m)
 {
     dmem_block_t *b = m->blocks->next;
     while (b != NULL) {
         dmem_block_t *next = b->next;
-        free(b);
+        _block_release(m, b);
         b = next;
     }
-    m->blocks->offset = m->blocks->origin;
+    _block_rewind(m->blocks, m->blocks->origin);
     m->blocks->next = NULL;
+    m->marked = NULL;
+
+#if defined(_MMAP) && defined(MADV_DONTNEED)
+    if (m->flags & DMEM_DECOMMIT) {
+        dmem_block_t *b = m->blocks;
+        madvise(b->origin, b->end - b->origin, MADV_DONTNEED);
+        b->zero = b->origin;
+    }
+#endif
+}
+
+#ifdef DMEM_STATS
+dmem_stats_t dmem_stats(const dmem_t *m)
+{
+    return m->stats;
+}
+
+void dmem_stats_reset(dmem_t *m)
+{
+    const size_t footprint = m->stats.footprint;
+    m->stats = (dmem_stats_t) {0};
+    m->stats.footprint = footprint;
+    m->stats.peak = footprint;
+}
+#endif
+
+void dmem_grow(dmem_t *m, unsigned factor, size_t max_block_size)
+{
+    m->growth = factor > 1 ? factor : 1;
+    // Sizes too large to be aligned, such as SIZE_MAX, are rounded down.
+    m->block_size_max = max_block_size > SIZE_MAX - DMEM_ALIGNMENT
+                        ? SIZE_MAX & ~(size_t) (DMEM_ALIGNMENT - 1)
+                        : _dmem_align(max_block_size);
+    if (m->block_size_max < m->block_size) {
+        m->block_size_max = m->block_size;
+    }
+}
+
+void *dmem_calloc(dmem_t *m, size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    size *= count;
+    char *a = dmem_alloc(m, size);
+    if (a == NULL || size == 0) {
+        return a;
+    }
+
+    // Allocations not made from the head block are given blocks of their own,
+    // which are placed right behind it.
+    const dmem_block_t *b = m->blocks;
+    if (a < b->origin || a >= b->end) {
+        b = b->next;
+    }
+    char *dirty = b->zero < &a[size] ? b->zero : &a[size];
+    if (a < dirty) {
+        memset(a, 0, dirty - a);
+    }
+    return a;
+}
+
+void *dmem_alloc_aligned(dmem_t *m, size_t size, size_t align)
+{
+    if (align == 0 || (align & (align - 1)) != 0) {
+        return NULL;
+    }
+    if (align <= DMEM_ALIGNMENT) {
+        return dmem_alloc(m, size);
+    }
+    if (size > SIZE_MAX - align - DMEM_ALIGNMENT) {
+        return NULL;
+    }
+    _STAT(m, allocations++);
+    _STAT(m, requested += size);
+    size_t n = _dmem_align(size);
+
+    dmem_block_t *b = m->blocks;
+    const size_t pad = -(uintptr_t) b->offset & (align - 1);
+    if (n <= m->block_size / 2 && pad + n <= _block_space_left(b)) {
+        _STAT(m, padding += pad + n - size);
+        char *a = &b->offset[pad];
+        b->offset = &a[n];
+        return a;
+    }
+
+    // Blocks are only aligned to DMEM_ALIGNMENT, which is why memory is taken
+    // for the worst case of padding.
+    n += align - DMEM_ALIGNMENT;
+    _STAT(m, padding += n - size);
+    char *a = _dmem_alloc(m, n);
+    if (a == NULL) {
+        return NULL;
+    }
+    return (char *) _round((uintptr_t) a, align);
+}
+
+void *dmem_alloc_isolated(dmem_t *m, size_t size)
+{
+    if (size > SIZE_MAX - DMEM_CACHE_LINE) {
+        return NULL;
+    }
+    size = _round(size != 0 ? size : 1, DMEM_CACHE_LINE);
+    return dmem_alloc_aligned(m, size, DMEM_CACHE_LINE);
+}
+
+static int _resize_last(dmem_t *m, char *a, const size_t old, const size_t new)
+{
+    // The most recent allocation ends at the offset of the head block. It
+    // may not be resized if made before a mark in the same block.
+    dmem_block_t *b = m->blocks;
+    if (a < b->origin || &a[old] != b->offset) {
+        return -1;
+    }
+    if (m->marked != NULL && m->marked >= b->origin && a < m->marked
+            && m->marked <= b->offset) {
+        return -1;
+    }
+    if (new > old && new - old > _block_space_left(b)) {
+        if (m->reserve == 0 || _reserved_extend(m, &a[new]) == -1) {
+            return -1;
+        }
+    }
+    _block_rewind(b, &a[new]);
+    return 0;
+}
+
+void *dmem_realloc(dmem_t *m, void *ptr, size_t old_size, size_t new_size)
+{
+    if (ptr == NULL) {
+        return dmem_alloc(m, new_size);
+    }
+    const size_t old = _dmem_align(old_size);
+    const size_t new = _dmem_align(new_size);
+    if (_resize_last(m, ptr, old, new) == 0) {
+        _STAT(m, requested += new_size - old_size);
+        return ptr;
+    }
+    if (new <= old) {
+        return ptr;
+    }
+
+    void *a = dmem_alloc(m, new_size);
+    if (a != NULL) {
+        memcpy(a, ptr, old_size);
+    }
+    return a;
+}
+
+void dmem_buf_init(dmem_buf_t *buf, dmem_t *m)
+{
+    buf->mem = m;
+    buf->data = NULL;
+    buf->size = 0;
+    buf->capacity = 0;
+}
+
+void *dmem_buf_reserve(dmem_buf_t *buf, size_t size)
+{
+    if (buf->capacity - buf->size < size) {
+        size_t capacity = buf->capacity != 0 ? buf->capacity * 2 : 16;
+        if (capacity < buf->size + size) {
+            capacity = buf->size + size;
+        }
+        char *data = dmem_realloc(buf->mem, buf->data, buf->capacity, capacity);
+        if (data == NULL) {
+            return NULL;
+        }
+        buf->data = data;
+        buf->capacity = capacity;
+    }
+    return &buf->data[buf->size];
+}
+
+void *dmem_buf_append(dmem_buf_t *buf, const void *data, size_t size)
+{
+    char *a = dmem_buf_reserve(buf, size);
+    if (a == NULL) {
+        return NULL;
+    }
+    memcpy(a, data, size);
+    buf->size += size;
+    return a;
+}
+
+dmem_mark_t dmem_mark(dmem_t *m)
+{
+    m->marked = m->blocks->offset;
+    dmem_mark_t mark = {m->blocks, m->blocks->next, m->blocks->offset};
+    return mark;
+}
+
+void dmem_rewind(dmem_t *m, dmem_mark_t mark)
+{
+    // Blocks created after the mark are either in front of the marked block,
+    // or right behind it if they were created by single block allocations.
+    dmem_block_t *b = m->blocks;
+    while (b != mark.block) {
+        dmem_block_t *next = b->next;
+        _block_release(m, b);
+        b = next;
+    }
+    b = mark.block->next;
+    while (b != mark.next) {
+        dmem_block_t *next = b->next;
+        _block_release(m, b);
+        b = next;
+    }
+    m->blocks = mark.block;
+    _block_rewind(m->blocks, mark.offset);
+    m->blocks->next = mark.next;
+
+    // Any earlier marks are at or before this one.
+    m->marked = mark.offset;
+}
+
+static size_t _spare_trim(dmem_t *m, const size_t limit)
+{
+    size_t released = 0;
+    while (m->retained > limit) {
+        dmem_block_t *b = m->spare;
+        m->spare = b->next;
+        m->retained -= _block_capacity(b);
+        released += _block_capacity(b);
+        _block_free(b);
+    }
+    return released;
+}
+
+void dmem_retain(dmem_t *m, size_t limit)
+{
+    m->retain_limit = limit;
+    _spare_trim(m, limit);
+}
+
+void dmem_mmap_threshold(dmem_t *m, size_t threshold)
+{
+    m->mmap_threshold = _dmem_align(threshold);
+}
+
+size_t dmem_trim(dmem_t *m, size_t keep)
+{
+    size_t released = _spare_trim(m, keep);
+
+#if defined(_MMAP) && defined(MADV_DONTNEED)
+    dmem_block_t *b = m->blocks;
+    if (m->reserve != 0 && keep < _block_space_left(b)) {
+        // Only whole pages can be given back, which are above the offset.
+        const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        char *start = &b->origin[_round(b->offset - b->origin + keep, page)];
+        if (start < b->end
+                && madvise(start, b->end - start, MADV_DONTNEED) == 0) {
+            released += b->end - start;
+            if (b->zero > start) {
+                b->zero = start;
+            }
+        }
+    }
+#endif
+    return released;
+}
+
+dmem_pool_t *dmem_pool_create(dmem_t *m, size_t slot_size)
+{
+    dmem_pool_t *p = dmem_alloc(m, sizeof(dmem_pool_t));
+    if (p == NULL) {
+        return NULL;
+    }
+    p->mem = m;
+    p->slot_size = slot_size > sizeof(void *) ? slot_size : sizeof(void *);
+    p->free = NULL;
+    return p;
+}
+
+void *dmem_pool_alloc(dmem_pool_t *p)
+{
+    void *slot = p->free;
+    if (slot == NULL) {
+        return dmem_alloc(p->mem, p->slot_size);
+    }
+    p->free = *(void **) slot;
+    return slot;
+}
+
+void dmem_pool_free(dmem_pool_t *p, void *slot)
+{
+    *(void **) slot = p->free;
+    p->free = slot;
+}
+
+/*
+DMEM image header. The image data follows at _IMAGE_OFFSET, which keeps it
+page aligned when mapped.
+*/
+typedef struct {
+    char magic[8];
+    uint32_t version, order, pointer_size, alignment;
+    uint64_t size;
+} _image_header_t;
+
+#define _IMAGE_MAGIC "DMEMIMG"
+#define _IMAGE_VERSION 1
+#define _IMAGE_OFFSET 4096
+
+static void _image_header_init(_image_header_t *h, const uint64_t size)
+{
+    memset(h, 0, sizeof(_image_header_t));
+    memcpy(h->magic, _IMAGE_MAGIC, sizeof(_IMAGE_MAGIC));
+    h->version = _IMAGE_VERSION;
+    h->order = 0x01020304;
+    h->pointer_size = sizeof(void *);
+    h->alignment = DMEM_ALIGNMENT;
+    h->size = size;
+}
+
+int dmem_save(const dmem_t *m, const char *path)
+{
+    const dmem_block_t *b = m->blocks;
+    if (b->next != NULL) {
+        return -1;
+    }
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+    static const char padding[_IMAGE_OFFSET] = {0};
+    const size_t size = b->offset - b->origin;
+
+    _image_header_t h;
+    _image_header_init(&h, size);
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1
+             && fwrite(padding, _IMAGE_OFFSET - sizeof(h), 1, f) == 1
+             && (size == 0 || fwrite(b->origin, size, 1, f) == 1);
+    if (fclose(f) != 0) {
+        ok = 0;
+    }
+    return ok ? 0 : -1;
+}
+
+void *dmem_load(const char *path, size_t *size)
+{
+#ifdef _MMAP
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < _IMAGE_OFFSET) {
+        close(fd);
+        return NULL;
+    }
+    char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                      fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    _image_header_t expected;
+    _image_header_init(&expected, st.st_size - _IMAGE_OFFSET);
+    if (memcmp(base, &expected, sizeof(_image_header_t)) != 0) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    *size = expected.size;
+    return &base[_IMAGE_OFFSET];
+#else
+    return NULL;
+#endif
+}
+
+void dmem_unload(void *image, size_t size)
+{
+#ifdef _MMAP
+    munmap((char *) image - _IMAGE_OFFSET, _IMAGE_OFFSET + size);
+#endif
+}
+
+typedef struct _member {
+    dmem_t *mem;
+    dmem_group_t *group;
+    struct _member *next, *next_idle;
+} _member_t;
+
+struct dmem_group {
+    pthread_key_t key;
+    pthread_mutex_t lock;
+    size_t block_size;
+    _member_t *members, *idle;
+};
+
+static void _member_release(void *member)
+{
+    _member_t *x = member;
+    dmem_group_t *g = x->group;
+    pthread_mutex_lock(&g->lock);
+    x->next_idle = g->idle;
+    g->idle = x;
+    pthread_mutex_unlock(&g->lock);
+}
+
+dmem_group_t *dmem_group_create(size_t block_size)
+{
+    dmem_group_t *g = malloc(sizeof(dmem_group_t));
+    if (g == NULL) {
+        return NULL;
+    }
+    if (pthread_key_create(&g->key, _member_release) != 0) {
+        free(g);
+        return NULL;
+    }
+    pthread_mutex_init(&g->lock, NULL);
+    g->block_size = block_size;
+    g->members = NULL;
+    g->idle = NULL;
+    return g;
+}
+
+void dmem_group_destroy(dmem_group_t *g)
+{
+    pthread_key_delete(g->key);
+    pthread_mutex_destroy(&g->lock);
+    _member_t *x = g->members;
+    while (x != NULL) {
+        _member_t *next = x->next;
+        dmem_destroy(x->mem);
+        free(x);
+        x = next;
+    }
+    free(g);
+}
+
+static _member_t *_member_acquire(dmem_group_t *g)
+{
+    pthread_mutex_lock(&g->lock);
+    _member_t *x = g->idle;
+    if (x != NULL) {
+        g->idle = x->next_idle;
+        pthread_mutex_unlock(&g->lock);
+        return x;
+    }
+    pthread_mutex_unlock(&g->lock);
+
+    x = malloc(sizeof(_member_t));
+    if (x == NULL) {
+        return NULL;
+    }
+    x->mem = dmem_create(g->block_size);
+    if (x->mem == NULL) {
+        free(x);
+        return NULL;
+    }
+    x->group = g;
+
+    pthread_mutex_lock(&g->lock);
+    x->next = g->members;
+    g->members = x;
+    pthread_mutex_unlock(&g->lock);
+    return x;
+}
+
+dmem_t *dmem_group_get(dmem_group_t *g)
+{
+    _member_t *x = pthread_getspecific(g->key);
+    if (x != NULL) {
+        return x->mem;
+    }
+    x = _member_acquire(g);
+    if (x == NULL) {
+        return NULL;
+    }
+    if (pthread_setspecific(g->key, x) != 0) {
+        _member_release(x);
+        return NULL;
+    }
+    return x->mem;
+}
+
+void dmem_group_reset(dmem_group_t *g)
+{
+    pthread_mutex_lock(&g->lock);
+    for (_member_t *x = g->members; x != NULL; x = x->next) {
+        dmem_reset(x->mem);
+    }
+    pthread_mutex_unlock(&g->lock);
 }
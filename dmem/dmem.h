@@ -13,30 +13,81 @@ following requirements:
 #ifndef DMEM_H
 #define DMEM_H
 
+#include <stddef.h>
 #include <stdlib.h>
 
 #ifndef DMEM_ALIGNMENT
 #define DMEM_ALIGNMENT sizeof(void *)
 #endif
 
+#ifndef DMEM_CACHE_LINE
+#define DMEM_CACHE_LINE 64
+#endif
+
 /*!
 Represents a dynamically sized block of bytes.
 */
 typedef struct dmem_block {
     char *origin, *offset;
     const char *end;
+    char *zero; // Memory after both zero and offset is known to be zeroed.
+    size_t mapped; // Size of own memory mapping, or zero if not mapped.
 
     struct dmem_block *next;
 } dmem_block_t;
 
+#ifdef DMEM_STATS
+/*!
+Represents allocation statistics of a DMEM object. Statistics are only kept if
+DMEM_STATS is defined when building.
+*/
+typedef struct {
+    size_t allocations, oversize; // Oversize allocations get blocks of own.
+    size_t requested, padding; // Bytes requested, and added by alignment.
+    size_t waste; // Bytes left unused at the ends of filled blocks.
+    size_t blocks; // Blocks taken into use.
+    size_t footprint, peak; // Bytes in blocks in use, now and at most.
+} dmem_stats_t;
+#endif
+
 /*!
 Represents a collection of related memory blocks.
 */
 typedef struct {
 	dmem_block_t *blocks;
 	size_t block_size;
+
+	dmem_block_t *spare; // Released blocks kept for reuse.
+	size_t retained, retain_limit;
+	struct {
+		size_t hits, misses;
+	} recycled;
+
+	unsigned growth;
+	size_t block_size_max;
+
+	size_t mmap_threshold; // Zero if oversize blocks are never mapped.
+
+	size_t reserve; // Only non-zero if created by dmem_create_reserved().
+	int flags;
+
+	char *marked; // Offset of the latest mark, or NULL.
+
+#ifdef DMEM_STATS
+	dmem_stats_t stats;
+#endif
 } dmem_t;
 
+/*!
+Flags accepted by dmem_create_reserved().
+
+DMEM_HUGE_PAGES asks for the reserved range to be backed by transparent huge
+pages, if supported. DMEM_DECOMMIT makes dmem_reset() return all committed
+memory to the operating system.
+*/
+#define DMEM_HUGE_PAGES 0x1
+#define DMEM_DECOMMIT   0x2
+
 /*!
 Creates a new DMEM object, keeping track of block of given size.
 
@@ -47,19 +98,142 @@ Returns NULL in case of memory allocation error.
 */
 dmem_t *dmem_create(size_t block_size);
 
+/*!
+Creates a new DMEM object, keeping all its memory in one contiguous range of
+reserve bytes of virtual memory. Parts of the range are made usable, block size
+bytes at a time, as allocations require it.
+
+Allocating more than reserve bytes from the object fails. Reserving a range is
+cheap, which is why reserve may be generously sized.
+
+Block size and reserve are rounded up to whole pages. Returns NULL in case
+reserve is zero, the range could not be reserved, or if virtual memory mapping
+is not supported on the platform.
+*/
+dmem_t *dmem_create_reserved(size_t block_size, size_t reserve, int flags);
+
 /*!
 Destroys given DMEM object, freeing any memory owned by it.
 */
 void dmem_destroy(dmem_t *m);
 
+static inline size_t _dmem_align(const size_t n)
+{
+    return (n + (DMEM_ALIGNMENT - 1)) & ~((size_t) DMEM_ALIGNMENT - 1);
+}
+
+void *_dmem_alloc(dmem_t *m, const size_t size);
+
 /*!
 Allocates size bytes of memory and returns a pointer to it. If a new block was
 required, but allocating such failed, NULL is returned.
 
 The returned memory is guaranteed to be valid until the next call of either
 dmem_reset() or dmem_free() on given DMEM object.
+
+Allocations fitting in the current block are made inline. Creating blocks is
+left to _dmem_alloc(), which expects size to be aligned.
+*/
+static inline void *dmem_alloc(dmem_t *m, size_t size)
+{
+#ifdef DMEM_STATS
+    m->stats.allocations++;
+    m->stats.requested += size;
+    m->stats.padding += _dmem_align(size) - size;
+#endif
+    size = _dmem_align(size);
+
+    dmem_block_t *b = m->blocks;
+    if (size <= m->block_size / 2 && size <= (size_t) (b->end - b->offset)) {
+        char *a = b->offset;
+        b->offset += size;
+        return a;
+    }
+    return _dmem_alloc(m, size);
+}
+
+/*!
+Allocates size bytes of memory, just like dmem_alloc(), but may be called by
+multiple threads at the same time on the same DMEM object.
+
+No other function may be called on the DMEM object while any thread could be
+calling this function.
+*/
+void *dmem_alloc_concurrent(dmem_t *m, size_t size);
+
+/*!
+Allocates memory for count objects of size bytes each, and returns a pointer to
+it after making sure it is zeroed. NULL is returned in case of memory allocation
+error or if the total size overflows.
+
+Only memory that has been used before, since it was obtained from the operating
+system, is cleared.
+*/
+void *dmem_calloc(dmem_t *m, size_t count, size_t size);
+
+/*!
+Allocates size bytes of memory aligned to align bytes, which must be a power of
+two, and returns a pointer to it. NULL is returned in case of memory allocation
+error or if align is not a power of two.
+
+If there is room for it, the allocation is padded into the current block.
+Otherwise, enough memory is taken from a new block for an aligned address to be
+found in it.
+*/
+void *dmem_alloc_aligned(dmem_t *m, size_t size, size_t align);
+
+/*!
+Allocates size bytes of memory occupying cache lines of DMEM_CACHE_LINE bytes
+not shared with any other allocation, and returns a pointer to it. NULL is
+returned in case of memory allocation error.
+
+Memory written frequently by different threads should be isolated like this, to
+avoid false sharing.
+*/
+void *dmem_alloc_isolated(dmem_t *m, size_t size);
+
+/*!
+Resizes memory at ptr, previously allocated from DMEM object with old_size
+bytes, to new_size bytes. If ptr is the most recent allocation, and was not
+made before the latest mark, it is resized in place if possible. Otherwise, new
+memory is allocated and the contents of the old are copied into it, leaving the
+old memory unused until reset.
+
+Returns pointer to resized memory, or NULL in case of memory allocation error.
+If ptr is NULL, the call is equivalent to dmem_alloc(m, new_size).
+*/
+void *dmem_realloc(dmem_t *m, void *ptr, size_t old_size, size_t new_size);
+
+/*!
+Represents a growable buffer of bytes, allocated from a DMEM object.
+*/
+typedef struct {
+    dmem_t *mem;
+    char *data;
+    size_t size, capacity;
+} dmem_buf_t;
+
+/*!
+Initializes empty buffer, which will allocate its memory from given DMEM
+object. Buffer memory is invalidated just like other DMEM memory.
+*/
+void dmem_buf_init(dmem_buf_t *buf, dmem_t *m);
+
+/*!
+Makes sure buffer has room for size more bytes, and returns pointer to where
+they would be added. The buffer size is not changed. NULL is returned in case of
+memory allocation error.
+
+The buffer capacity is at least doubled when it grows. Growth happens in place
+if no other memory was allocated from its DMEM object since it last grew.
+*/
+void *dmem_buf_reserve(dmem_buf_t *buf, size_t size);
+
+/*!
+Appends size bytes of data to buffer, and returns pointer to where they were
+added. NULL is returned in case of memory allocation error.
 */
-void *dmem_alloc(dmem_t *m, size_t size);
+void *dmem_buf_append(dmem_buf_t *buf, const void *data, size_t size);
 
 /*!
 Resets DMEM object, invalidating all memory, previously distributed using the
@@ -67,4 +241,209 @@ dmem_get() function.
 */
 void dmem_reset(dmem_t *m);
 
+/*!
+Makes DMEM object multiply its block size by factor whenever it creates a new
+block, until the block size reaches max_block_size. Allocations larger than
+half the current block size are given blocks of their own.
+
+The block size is not reduced by dmem_reset(). Blocks made by
+dmem_alloc_concurrent(), or by reserved DMEM objects, do not grow.
+*/
+void dmem_grow(dmem_t *m, unsigned factor, size_t max_block_size);
+
+/*!
+Represents a position in a DMEM object, to which it can later be rewound.
+*/
+typedef struct {
+    dmem_block_t *block, *next;
+    char *offset;
+} dmem_mark_t;
+
+/*!
+Returns mark representing current position of given DMEM object.
+
+Allocations made before the mark are never resized in place afterwards, as
+growing them past the mark would leave them partly invalidated by a rewind.
+*/
+dmem_mark_t dmem_mark(dmem_t *m);
+
+/*!
+Rewinds DMEM object to given mark, invalidating all memory distributed since
+the mark was made. Blocks added since are released just like by dmem_reset().
+
+The mark must have been made on the same DMEM object, and it must not have been
+reset or rewound to an earlier mark since.
+*/
+void dmem_rewind(dmem_t *m, dmem_mark_t mark);
+
+/*!
+Sets the amount of bytes of released blocks DMEM object may keep for later
+reuse, instead of freeing them. Blocks are released by dmem_reset(). The limit
+is zero by default.
+
+The recycled member of given DMEM object counts how many times a new block was
+taken from the kept blocks (hits) rather than being allocated (misses).
+*/
+void dmem_retain(dmem_t *m, size_t limit);
+
+/*!
+Makes DMEM object map memory directly from the operating system for
+allocations of at least threshold bytes that are given blocks of their own.
+Such blocks are unmapped as soon as they are released, and are never retained.
+A threshold of zero, which is the default, disables mapping.
+
+Reserved DMEM objects never give allocations blocks of their own, and are not
+affected by the threshold.
+*/
+void dmem_mmap_threshold(dmem_t *m, size_t threshold);
+
+/*!
+Returns memory no longer in use by DMEM object to the operating system, keeping
+at most keep bytes of it for later reuse. Returns the number of bytes released.
+
+Blocks retained for reuse are freed. Reserved DMEM objects instead return
+committed memory beyond their current offset, which remains committed but is
+given back zeroed pages when used again.
+*/
+size_t dmem_trim(dmem_t *m, size_t keep);
+
+#ifdef DMEM_STATS
+/*!
+Returns allocation statistics of given DMEM object. Allocations made using
+dmem_alloc_concurrent() are not counted, but the blocks added by them are.
+*/
+dmem_stats_t dmem_stats(const dmem_t *m);
+
+/*!
+Zeroes all allocation statistics of given DMEM object, except for its current
+footprint, which also becomes its peak footprint.
+*/
+void dmem_stats_reset(dmem_t *m);
+#endif
+
+/*!
+Represents a pool of equally sized slots, allocated from a DMEM object.
+*/
+typedef struct {
+    dmem_t *mem;
+    size_t slot_size;
+    void *free; // Freed slots, linked through their first bytes.
+} dmem_pool_t;
+
+/*!
+Creates a pool of slots of slot_size bytes, allocated from given DMEM object.
+Returns NULL in case of memory allocation error.
+
+The pool itself resides in the DMEM object. It is, together with all its
+slots, invalidated by dmem_reset() and dmem_destroy(). It must not be used
+after rewinding the DMEM object to a mark made after the pool was created.
+*/
+dmem_pool_t *dmem_pool_create(dmem_t *m, size_t slot_size);
+
+/*!
+Returns a pointer to an unused slot of given pool. Freed slots are handed out
+before new ones are allocated. NULL is returned in case of memory allocation
+error.
+*/
+void *dmem_pool_alloc(dmem_pool_t *p);
+
+/*!
+Returns slot to given pool, making it available to dmem_pool_alloc().
+*/
+void dmem_pool_free(dmem_pool_t *p, void *slot);
+
+/*!
+Represents a pointer stored as the distance from its own location to its
+target. It remains valid if moved together with its target, as happens when a
+DMEM object is saved and loaded again.
+
+One represents NULL, as no pointer can point into its own second byte, which
+leaves zero for pointers to themselves. **A zeroed relative pointer points to
+itself, and is not NULL.** Relative pointers must therefore be set using
+dmem_rel_set(), or be initialized to DMEM_REL_NULL, before use.
+*/
+typedef ptrdiff_t dmem_rel_t;
+
+/*!
+Initializer of relative pointers that are NULL.
+*/
+#define DMEM_REL_NULL 1
+
+/*!
+Makes relative pointer at r point to ptr.
+*/
+static inline void dmem_rel_set(dmem_rel_t *r, const void *ptr)
+{
+    *r = ptr != NULL ? (const char *) ptr - (const char *) r : DMEM_REL_NULL;
+}
+
+/*!
+Returns pointer to target of relative pointer at r.
+*/
+static inline void *dmem_rel_get(const dmem_rel_t *r)
+{
+    return *r != DMEM_REL_NULL ? (char *) r + *r : NULL;
+}
+
+/*!
+Writes the memory of given DMEM object to a file at path, as a contiguous
+image. The first allocation made from the object is at the start of the image.
+Returns 0 on success.
+
+Only DMEM objects consisting of a single block, such as reserved ones, can be
+saved. Pointers into the saved memory should be relative pointers, for them to
+be valid when loaded. -1 is returned if the object has more than one block, or
+if the file could not be written.
+*/
+int dmem_save(const dmem_t *m, const char *path);
+
+/*!
+Maps an image written by dmem_save() into memory, and returns pointer to its
+start. The image size is written to size. Pages of the image are read from the
+file as they are accessed. Changes made to them are private to the process.
+
+NULL is returned if the file could not be mapped, or if it was not written by
+a compatible build of DMEM.
+*/
+void *dmem_load(const char *path, size_t *size);
+
+/*!
+Unmaps image previously returned by dmem_load().
+*/
+void dmem_unload(void *image, size_t size);
+
+/*!
+Represents a group of DMEM objects, each of which is used by one thread.
+*/
+typedef struct dmem_group dmem_group_t;
+
+/*!
+Creates a new group of DMEM objects, each created with given block size when
+first requested by a thread. Returns NULL in case of memory allocation error,
+or if no more thread-local storage keys are available.
+*/
+dmem_group_t *dmem_group_create(size_t block_size);
+
+/*!
+Destroys group and all its DMEM objects. No thread may use any of the objects
+while or after the group is destroyed.
+*/
+void dmem_group_destroy(dmem_group_t *g);
+
+/*!
+Returns the DMEM object of the calling thread, creating it if the thread has
+none. NULL is returned in case of memory allocation error.
+
+When a thread exits, its object is kept by the group and handed to the next
+thread that needs one. Memory allocated from it remains valid until the group
+is reset.
+*/
+dmem_t *dmem_group_get(dmem_group_t *g);
+
+/*!
+Resets all DMEM objects of group. No thread may use any of the objects while
+the group is reset.
+*/
+void dmem_group_reset(dmem_group_t *g);
+
 #endif
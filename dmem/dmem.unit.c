@@ -1,4 +1,7 @@
 #include <../unit/unit.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 /*
@@ -13,8 +16,30 @@ void test_alloc_beyond_capacity(T_t *T, void *m);
 void test_alloc_larger_than_block_size(T_t *T, void *m);
 void test_reset(T_t *T, void *m);
 void test_reset_multiblock(T_t *T, void *m);
+void test_alloc_concurrent(T_t *T, void *m);
+void test_reset_recycle(T_t *T, void *m);
+void test_reserved_contiguous(T_t *T, void *m);
+void test_create_reserved_sizes(T_t *T, void *_);
+void test_mark_rewind(T_t *T, void *m);
+void test_grow(T_t *T, void *m);
+void test_pool(T_t *T, void *m);
+#ifdef DMEM_STATS
+void test_stats(T_t *T, void *m);
+#endif
+void test_realloc(T_t *T, void *m);
+void test_realloc_mark(T_t *T, void *m);
+void test_buf_append(T_t *T, void *m);
+void test_save_load(T_t *T, void *m);
+void test_calloc(T_t *T, void *m);
+void test_group(T_t *T, void *_);
+void test_mmap_threshold(T_t *T, void *m);
+void test_trim(T_t *T, void *m);
+void test_trim_reserved(T_t *T, void *m);
+void test_alloc_aligned(T_t *T, void *m);
+void test_alloc_isolated(T_t *T, void *m);
 
 void provider_dmem(T_t *T, unit_test_t test);
+void provider_dmem_reserved(T_t *T, unit_test_t test);
 
 void suite_dmem(T_t *T)
 {
@@ -23,6 +48,45 @@ void suite_dmem(T_t *T)
     unit_run_test(T, &test_alloc_larger_than_block_size, &provider_dmem);
     unit_run_test(T, &test_reset, &provider_dmem);
     unit_run_test(T, &test_reset_multiblock, &provider_dmem);
+    unit_run_test(T, &test_alloc_concurrent, &provider_dmem);
+    unit_run_test(T, &test_reset_recycle, &provider_dmem);
+    unit_run_test(T, &test_mark_rewind, &provider_dmem);
+    unit_run_test(T, &test_grow, &provider_dmem);
+    unit_run_test(T, &test_pool, &provider_dmem);
+#ifdef DMEM_STATS
+    unit_run_test(T, &test_stats, &provider_dmem);
+#endif
+    unit_run_test(T, &test_realloc, &provider_dmem);
+    unit_run_test(T, &test_realloc_mark, &provider_dmem);
+    unit_run_test(T, &test_buf_append, &provider_dmem);
+    unit_run_test(T, &test_calloc, &provider_dmem);
+    unit_run_test(T, &test_group, NULL);
+    unit_run_test(T, &test_mmap_threshold, &provider_dmem);
+    unit_run_test(T, &test_trim, &provider_dmem);
+    unit_run_test(T, &test_alloc_aligned, &provider_dmem);
+    unit_run_test(T, &test_alloc_isolated, &provider_dmem);
+}
+
+void suite_dmem_reserved(T_t *T)
+{
+    unit_run_test(T, &test_alloc, &provider_dmem_reserved);
+    unit_run_test(T, &test_alloc_beyond_capacity, &provider_dmem_reserved);
+    unit_run_test(T, &test_alloc_larger_than_block_size, &provider_dmem_reserved);
+    unit_run_test(T, &test_reset, &provider_dmem_reserved);
+    unit_run_test(T, &test_reset_multiblock, &provider_dmem_reserved);
+    unit_run_test(T, &test_alloc_concurrent, &provider_dmem_reserved);
+    unit_run_test(T, &test_reserved_contiguous, &provider_dmem_reserved);
+    unit_run_test(T, &test_create_reserved_sizes, NULL);
+    unit_run_test(T, &test_mark_rewind, &provider_dmem_reserved);
+    unit_run_test(T, &test_pool, &provider_dmem_reserved);
+    unit_run_test(T, &test_realloc, &provider_dmem_reserved);
+    unit_run_test(T, &test_realloc_mark, &provider_dmem_reserved);
+    unit_run_test(T, &test_buf_append, &provider_dmem_reserved);
+    unit_run_test(T, &test_save_load, &provider_dmem_reserved);
+    unit_run_test(T, &test_calloc, &provider_dmem_reserved);
+    unit_run_test(T, &test_trim_reserved, &provider_dmem_reserved);
+    unit_run_test(T, &test_alloc_aligned, &provider_dmem_reserved);
+    unit_run_test(T, &test_alloc_isolated, &provider_dmem_reserved);
 }
 
 int main()
@@ -30,6 +94,7 @@ int main()
     unit_t u;
     unit_init(&u);
     unit_run_suite(&u, "dmem", &suite_dmem);
+    unit_run_suite(&u, "dmem_reserved", &suite_dmem_reserved);
     unit_exit(&u);
 }
 
@@ -142,6 +207,653 @@ void test_reset_multiblock(T_t *T, void *m)
     }
 }
 
+#define CONCURRENT_THREADS 4
+#define CONCURRENT_ALLOCS 1000
+
+typedef struct {
+    dmem_t *m;
+    unsigned char id;
+    unsigned char *allocs[CONCURRENT_ALLOCS];
+} concurrent_worker_t;
+
+size_t concurrent_size(size_t i)
+{
+    // Every 16th allocation is larger than half of the block size.
+    return (i % 16 == 0) ? 40 : 1 + i % 24;
+}
+
+void *concurrent_worker(void *arg)
+{
+    concurrent_worker_t *w = arg;
+    for (size_t i = 0; i < CONCURRENT_ALLOCS; ++i) {
+        unsigned char *v = dmem_alloc_concurrent(w->m, concurrent_size(i));
+        if (v != NULL) {
+            memset(v, w->id, concurrent_size(i));
+        }
+        w->allocs[i] = v;
+    }
+    return NULL;
+}
+
+void test_alloc_concurrent(T_t *T, void *m)
+{
+    static concurrent_worker_t workers[CONCURRENT_THREADS];
+    pthread_t threads[CONCURRENT_THREADS];
+
+    for (size_t i = 0; i < CONCURRENT_THREADS; ++i) {
+        workers[i].m = m;
+        workers[i].id = i + 1;
+        if (pthread_create(&threads[i], NULL, concurrent_worker, &workers[i]) != 0) {
+            unit_fatalf(T, "pthread_create() failed (i: %zu)", i);
+        }
+    }
+    for (size_t i = 0; i < CONCURRENT_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Overlapping allocations would have had their contents overwritten.
+    for (size_t i = 0; i < CONCURRENT_THREADS; ++i) {
+        for (size_t j = 0; j < CONCURRENT_ALLOCS; ++j) {
+            const unsigned char *v = workers[i].allocs[j];
+            if (v == NULL) {
+                unit_failf(T, "v == NULL (i: %zu, j: %zu)", i, j);
+                return;
+            }
+            for (size_t k = 0; k < concurrent_size(j); ++k) {
+                if (v[k] != workers[i].id) {
+                    unit_failf(T, "v[%zu] != %u (i: %zu, j: %zu)", k,
+                               workers[i].id, i, j);
+                    return;
+                }
+            }
+        }
+    }
+}
+
+void test_reset_recycle(T_t *T, void *m)
+{
+    dmem_t *mem = m;
+    dmem_retain(mem, 4096);
+
+    for (size_t cycle = 0; cycle < 3; ++cycle) {
+        for (size_t i = 0; i < 64; ++i) {
+            if (dmem_alloc(mem, 24) == NULL) {
+                unit_failf(T, "dmem_alloc() == NULL (i: %zu)", i);
+                return;
+            }
+        }
+        dmem_reset(mem);
+        if (mem->retained > mem->retain_limit) {
+            unit_failf(T, "%zu > %zu", mem->retained, mem->retain_limit);
+        }
+    }
+
+    // Only the first cycle should have had to allocate new blocks.
+    const size_t misses = mem->recycled.misses;
+    unit_assert(T, mem->recycled.hits == 2 * misses);
+
+    dmem_retain(mem, 0);
+    unit_assert(T, mem->spare == NULL);
+    unit_assert(T, mem->retained == 0);
+}
+
+void test_reserved_contiguous(T_t *T, void *m)
+{
+    dmem_t *mem = m;
+    char *v0 = dmem_alloc(mem, 24);
+    for (size_t i = 0; i < 10000; ++i) {
+        char *v1 = dmem_alloc(mem, 1000);
+        if (v1 == NULL) {
+            unit_failf(T, "v1 == NULL (i: %zu)", i);
+            return;
+        }
+        memset(v1, 0xff, 1000);
+        if (v1 != &v0[i == 0 ? 24 : 1000]) {
+            unit_failf(T, "allocation not contiguous (i: %zu)", i);
+            return;
+        }
+        v0 = v1;
+    }
+
+    // Allocations beyond the reserved range must fail rather than spill.
+    unit_assert(T, dmem_alloc(mem, mem->reserve) == NULL);
+
+    dmem_reset(mem);
+    unit_assert(T, mem->blocks->offset == mem->blocks->origin);
+}
+
+void test_create_reserved_sizes(T_t *T, void *_)
+{
+    (void) _;
+
+    unit_assert(T, dmem_create_reserved(64, 0, 0) == NULL);
+
+    // Block sizes are made at least one page large.
+    dmem_t *m = dmem_create_reserved(0, 1 << 20, 0);
+    if (m == NULL) {
+        unit_skip(T, "Reserved DMEM objects not supported.");
+    }
+    unit_assert(T, m->block_size != 0);
+    unit_assert(T, dmem_alloc(m, 100) != NULL);
+    unit_assert(T, dmem_alloc(m, 10000) != NULL);
+    dmem_destroy(m);
+}
+
+size_t count_blocks(const dmem_t *m)
+{
+    size_t n = 0;
+    for (const dmem_block_t *b = m->blocks; b != NULL; b = b->next) {
+        ++n;
+    }
+    return n;
+}
+
+void test_mark_rewind(T_t *T, void *m)
+{
+    char *v0 = dmem_alloc(m, 16);
+    const size_t blocks = count_blocks(m);
+
+    for (size_t frame = 0; frame < 4; ++frame) {
+        dmem_mark_t mark = dmem_mark(m);
+        for (size_t i = 0; i < 100; ++i) {
+            // Every tenth allocation requires a block of its own.
+            if (dmem_alloc(m, i % 10 == 0 ? 100 : 24) == NULL) {
+                unit_failf(T, "dmem_alloc() == NULL (i: %zu)", i);
+                return;
+            }
+        }
+        dmem_rewind(m, mark);
+
+        if (count_blocks(m) != blocks) {
+            unit_failf(T, "%zu != %zu (frame: %zu)", count_blocks(m), blocks, frame);
+        }
+    }
+
+    // The next allocation should reuse the memory right after v0.
+    char *v1 = dmem_alloc(m, 16);
+    unit_assert(T, v1 == &v0[16]);
+}
+
+void test_grow(T_t *T, void *m)
+{
+    dmem_t *mem = m;
+    dmem_grow(mem, 2, 1024);
+
+    for (size_t i = 0; i < 1000; ++i) {
+        if (dmem_alloc(mem, 24) == NULL) {
+            unit_failf(T, "dmem_alloc() == NULL (i: %zu)", i);
+            return;
+        }
+    }
+    unit_assert(T, mem->block_size == 1024);
+
+    // Without growth, 64 byte blocks would have required 500 blocks.
+    const size_t blocks = count_blocks(mem);
+    if (blocks > 30) {
+        unit_failf(T, "%zu blocks allocated", blocks);
+    }
+
+    // Allocations of up to half the new block size share blocks.
+    char *v = dmem_alloc(mem, 400);
+    unit_assert(T, v >= mem->blocks->origin && v < mem->blocks->end);
+
+    // A maximum of SIZE_MAX leaves growth unbounded.
+    dmem_grow(mem, 2, SIZE_MAX);
+    unit_assert(T, mem->block_size_max >= mem->block_size);
+    for (size_t i = 0; i < 100; ++i) {
+        dmem_alloc(mem, 24);
+    }
+    unit_assert(T, mem->block_size > 1024);
+}
+
+void test_pool(T_t *T, void *m)
+{
+    dmem_pool_t *p = dmem_pool_create(m, 12);
+    if (p == NULL) {
+        unit_fatal(T, "p == NULL");
+    }
+
+    char *slots[100];
+    for (size_t i = 0; i < 100; ++i) {
+        slots[i] = dmem_pool_alloc(p);
+        if (slots[i] == NULL) {
+            unit_failf(T, "slots[%zu] == NULL", i);
+            return;
+        }
+        memset(slots[i], (int) i, 12);
+    }
+    for (size_t i = 0; i < 100; i += 2) {
+        dmem_pool_free(p, slots[i]);
+    }
+
+    // Freed slots are handed out again, most recently freed first.
+    for (size_t i = 100; i != 0; i -= 2) {
+        char *v = dmem_pool_alloc(p);
+        if (v != slots[i - 2]) {
+            unit_failf(T, "v != slots[%zu]", i - 2);
+        }
+    }
+    for (size_t i = 1; i < 100; i += 2) {
+        if (slots[i][0] != (char) i || slots[i][11] != (char) i) {
+            unit_failf(T, "slots[%zu] overwritten", i);
+        }
+    }
+}
+
+#ifdef DMEM_STATS
+void test_stats(T_t *T, void *m)
+{
+    dmem_stats_reset(m);
+
+    dmem_alloc(m, 5);
+    dmem_stats_t s = dmem_stats(m);
+    unit_assert(T, s.allocations == 1);
+    unit_assert(T, s.requested == 5);
+    unit_assert(T, s.padding == 3);
+    unit_assert(T, s.footprint == 64);
+
+    // Leaves 8 bytes unused at the end of the first block.
+    dmem_alloc(m, 24);
+    dmem_alloc(m, 24);
+    dmem_alloc(m, 24);
+    s = dmem_stats(m);
+    unit_assert(T, s.waste == 8);
+    unit_assert(T, s.blocks == 1);
+    unit_assert(T, s.footprint == 128);
+
+    dmem_alloc(m, 100);
+    s = dmem_stats(m);
+    unit_assert(T, s.oversize == 1);
+    unit_assert(T, s.blocks == 2);
+    unit_assert(T, s.footprint == 232);
+
+    dmem_reset(m);
+    s = dmem_stats(m);
+    unit_assert(T, s.footprint == 64);
+    unit_assert(T, s.peak == 232);
+
+    // Blocks added by concurrent allocations are counted as well.
+    for (size_t i = 0; i < 20; ++i) {
+        dmem_alloc_concurrent(m, i % 2 == 0 ? 48 : 100);
+    }
+    s = dmem_stats(m);
+    unit_assert(T, s.footprint > 64 + 10 * 100);
+    dmem_reset(m);
+    s = dmem_stats(m);
+    unit_assert(T, s.footprint == 64);
+    unit_assert(T, s.peak > 64 + 10 * 100);
+}
+#endif
+
+void test_realloc(T_t *T, void *m)
+{
+    char *v0 = dmem_alloc(m, 8);
+    memcpy(v0, "abcdefg", 8);
+
+    // The most recent allocation grows and shrinks in place.
+    char *v1 = dmem_realloc(m, v0, 8, 24);
+    unit_assert(T, v1 == v0);
+    v1 = dmem_realloc(m, v1, 24, 16);
+    unit_assert(T, v1 == v0);
+    unit_assert(T, dmem_alloc(m, 8) == &v0[16]);
+
+    // Other allocations are moved.
+    char *v2 = dmem_realloc(m, v1, 16, 32);
+    if (v2 == NULL) {
+        unit_fail(T, "v2 == NULL");
+        return;
+    }
+    unit_assert(T, v2 != v1);
+    unit_assert(T, strcmp(v2, "abcdefg") == 0);
+}
+
+void test_realloc_mark(T_t *T, void *m)
+{
+    char *v0 = dmem_alloc(m, 8);
+    memcpy(v0, "abcdefg", 8);
+
+    // Allocations made before a mark are not grown past it.
+    dmem_mark_t mark = dmem_mark(m);
+    char *v1 = dmem_realloc(m, v0, 8, 24);
+    if (v1 == NULL) {
+        unit_fail(T, "v1 == NULL");
+        return;
+    }
+    unit_assert(T, v1 != v0);
+    unit_assert(T, strcmp(v1, "abcdefg") == 0);
+
+    // Rewinding keeps the memory allocated before the mark intact.
+    dmem_rewind(m, mark);
+    char *v2 = dmem_alloc(m, 8);
+    unit_assert(T, v2 == &v0[8]);
+    memset(v2, 'x', 8);
+    unit_assert(T, strcmp(v0, "abcdefg") == 0);
+
+    // Allocations made after the mark still grow in place.
+    char *v3 = dmem_realloc(m, v2, 8, 16);
+    unit_assert(T, v3 == v2);
+}
+
+void test_buf_append(T_t *T, void *m)
+{
+    dmem_buf_t buf;
+    dmem_buf_init(&buf, m);
+
+    for (size_t i = 0; i < 1000; ++i) {
+        if (dmem_buf_append(&buf, "0123456789", 10) == NULL) {
+            unit_failf(T, "dmem_buf_append() == NULL (i: %zu)", i);
+            return;
+        }
+    }
+    unit_assert(T, buf.size == 10000);
+    unit_assert(T, buf.capacity >= buf.size);
+    for (size_t i = 0; i < buf.size; ++i) {
+        if (buf.data[i] != '0' + (char) (i % 10)) {
+            unit_failf(T, "buf.data[%zu] == '%c'", i, buf.data[i]);
+            return;
+        }
+    }
+}
+
+typedef struct {
+    dmem_rel_t next;
+    size_t value;
+} list_node_t;
+
+void test_save_load(T_t *T, void *m)
+{
+    const char *path = "dmem.unit.img";
+
+    list_node_t *n = dmem_alloc(m, sizeof(list_node_t));
+    for (size_t i = 0; i < 10000; ++i) {
+        list_node_t *next = NULL;
+        if (i + 1 < 10000) {
+            next = dmem_alloc(m, sizeof(list_node_t));
+        }
+        n->value = i;
+        dmem_rel_set(&n->next, next);
+        n = next;
+    }
+    if (dmem_save(m, path) != 0) {
+        unit_fail(T, "dmem_save() != 0");
+        return;
+    }
+
+    size_t size;
+    list_node_t *image = dmem_load(path, &size);
+    remove(path);
+    if (image == NULL) {
+        unit_fail(T, "image == NULL");
+        return;
+    }
+    unit_assert(T, size == 10000 * sizeof(list_node_t));
+
+    size_t i = 0;
+    for (n = image; n != NULL; n = dmem_rel_get(&n->next), ++i) {
+        if (n->value != i) {
+            unit_failf(T, "n->value %zu != %zu", n->value, i);
+            break;
+        }
+    }
+    unit_assert(T, i == 10000);
+    dmem_unload(image, size);
+
+    // Pointers to themselves are not mistaken for NULL, while zeroed
+    // pointers point to themselves.
+    list_node_t self = {DMEM_REL_NULL, 0};
+    unit_assert(T, dmem_rel_get(&self.next) == NULL);
+    dmem_rel_set(&self.next, &self);
+    unit_assert(T, dmem_rel_get(&self.next) == &self);
+    self.next = 0;
+    unit_assert(T, dmem_rel_get(&self.next) == &self.next);
+
+    // Objects with more than one block cannot be saved.
+    dmem_t *m1 = dmem_create(64);
+    if (m1 == NULL) {
+        unit_fatal(T, "m1 == NULL");
+    }
+    dmem_alloc(m1, 100);
+    unit_assert(T, dmem_save(m1, path) == -1);
+    dmem_destroy(m1);
+}
+
+int is_zeroed(const unsigned char *v, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        if (v[i] != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void test_calloc(T_t *T, void *m)
+{
+    const size_t sizes[] = {4, 16, 24, 40, 100, 1000};
+    const size_t n = sizeof(sizes) / sizeof(sizes[0]);
+
+    for (size_t cycle = 0; cycle < 3; ++cycle) {
+        dmem_mark_t mark = dmem_mark(m);
+        for (size_t i = 0; i < 50 * n; ++i) {
+            unsigned char *v = dmem_calloc(m, 1, sizes[i % n]);
+            if (v == NULL) {
+                unit_failf(T, "v == NULL (i: %zu)", i);
+                return;
+            }
+            if (!is_zeroed(v, sizes[i % n])) {
+                unit_failf(T, "v not zeroed (cycle: %zu, i: %zu)", cycle, i);
+                return;
+            }
+            memset(v, 0xff, sizes[i % n]);
+            memset(dmem_alloc(m, 8), 0xff, 8);
+        }
+        if (cycle == 0) {
+            dmem_rewind(m, mark);
+        } else {
+            dmem_reset(m);
+        }
+    }
+    unit_assert(T, dmem_calloc(m, SIZE_MAX / 2, 4) == NULL);
+}
+
+#define GROUP_THREADS 4
+
+typedef struct {
+    dmem_group_t *g;
+    dmem_t *m;
+    int *v;
+} group_worker_t;
+
+void *group_worker(void *arg)
+{
+    group_worker_t *w = arg;
+    w->m = dmem_group_get(w->g);
+    if (w->m != NULL && dmem_group_get(w->g) != w->m) {
+        w->m = NULL;
+    }
+    if (w->m != NULL) {
+        w->v = dmem_alloc(w->m, sizeof(int));
+    }
+    return NULL;
+}
+
+void test_group(T_t *T, void *_)
+{
+    (void) _;
+
+    dmem_group_t *g = dmem_group_create(64);
+    if (g == NULL) {
+        unit_fatal(T, "g == NULL");
+    }
+    group_worker_t first[GROUP_THREADS], second[GROUP_THREADS];
+    pthread_t threads[GROUP_THREADS];
+
+    for (size_t i = 0; i < GROUP_THREADS; ++i) {
+        first[i] = (group_worker_t) {g, NULL, NULL};
+        pthread_create(&threads[i], NULL, group_worker, &first[i]);
+    }
+    for (size_t i = 0; i < GROUP_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+        if (first[i].m == NULL || first[i].v == NULL) {
+            unit_failf(T, "first[%zu] failed", i);
+            dmem_group_destroy(g);
+            return;
+        }
+    }
+
+    // Threads started after the first ones exited reuse their objects.
+    for (size_t i = 0; i < GROUP_THREADS; ++i) {
+        second[i] = (group_worker_t) {g, NULL, NULL};
+        pthread_create(&threads[i], NULL, group_worker, &second[i]);
+        pthread_join(threads[i], NULL);
+
+        int reused = 0;
+        for (size_t j = 0; j < GROUP_THREADS; ++j) {
+            reused |= second[i].m == first[j].m;
+        }
+        if (!reused) {
+            unit_failf(T, "second[%zu] did not reuse object", i);
+        }
+    }
+
+    dmem_group_reset(g);
+    for (size_t i = 0; i < GROUP_THREADS; ++i) {
+        dmem_block_t *b = first[i].m->blocks;
+        unit_assert(T, b->offset == b->origin);
+    }
+    dmem_group_destroy(g);
+}
+
+void test_mmap_threshold(T_t *T, void *m)
+{
+    dmem_t *mem = m;
+    dmem_retain(mem, 1 << 20);
+    dmem_mmap_threshold(mem, 4096);
+
+    for (size_t cycle = 0; cycle < 3; ++cycle) {
+        unsigned char *v = dmem_calloc(mem, 1, 8192);
+        if (v == NULL) {
+            unit_fatal(T, "v == NULL");
+        }
+        unit_assert(T, mem->blocks->next->mapped != 0);
+        unit_assert(T, is_zeroed(v, 8192));
+        memset(v, 0xff, 8192);
+
+        // Oversize allocations below the threshold are not mapped.
+        v = dmem_alloc(mem, 100);
+        unit_assert(T, mem->blocks->next->mapped == 0);
+        memset(v, 0xff, 100);
+
+        dmem_reset(mem);
+        for (dmem_block_t *b = mem->spare; b != NULL; b = b->next) {
+            unit_assert(T, b->mapped == 0);
+        }
+    }
+    unit_assert(T, mem->recycled.hits == 2);
+}
+
+void test_trim(T_t *T, void *m)
+{
+    dmem_t *mem = m;
+    dmem_retain(mem, 1 << 20);
+    for (size_t i = 0; i < 16; ++i) {
+        if (dmem_alloc(mem, 1000) == NULL) {
+            unit_fatal(T, "dmem_alloc() == NULL");
+        }
+    }
+    dmem_reset(mem);
+
+    const size_t retained = mem->retained;
+    unit_assert(T, retained == 16 * 1000);
+    unit_assert(T, dmem_trim(mem, 4000) == retained - 4000);
+    unit_assert(T, mem->retained == 4000);
+    unit_assert(T, dmem_trim(mem, 0) == 4000);
+    unit_assert(T, mem->spare == NULL);
+    unit_assert(T, mem->retain_limit == 1 << 20);
+}
+
+void test_trim_reserved(T_t *T, void *m)
+{
+    dmem_t *mem = m;
+    unsigned char *v = dmem_alloc(mem, 1 << 16);
+    if (v == NULL) {
+        unit_fatal(T, "v == NULL");
+    }
+    memset(v, 0xff, 1 << 16);
+
+    dmem_mark_t mark = dmem_mark(mem);
+    memset(dmem_alloc(mem, 1 << 16), 0xff, 1 << 16);
+    dmem_rewind(mem, mark);
+
+    // Memory in use is kept, as is committed memory up to keep bytes past it.
+    dmem_block_t *b = mem->blocks;
+    const size_t committed = b->end - b->origin;
+    const size_t released = dmem_trim(mem, 4096);
+    unit_assert(T, released == committed - (1 << 16) - 4096);
+    unit_assert(T, b->end - b->origin == (ptrdiff_t) committed);
+    unit_assert(T, v[(1 << 16) - 1] == 0xff);
+
+    unsigned char *w = dmem_calloc(mem, 1, 1 << 16);
+    unit_assert(T, w == &v[1 << 16]);
+    unit_assert(T, is_zeroed(w, 1 << 16));
+}
+
+void test_alloc_aligned(T_t *T, void *m)
+{
+    const size_t aligns[] = {1, 8, 16, 32, 64, 4096};
+    const size_t sizes[] = {1, 8, 24, 32, 100, 5000};
+    const size_t n = sizeof(aligns) / sizeof(aligns[0]);
+
+    for (size_t i = 0; i < 20 * n; ++i) {
+        const size_t align = aligns[i % n], size = sizes[(i / n) % n];
+        char *v = dmem_alloc_aligned(m, size, align);
+        if (v == NULL) {
+            unit_failf(T, "v == NULL (i: %zu)", i);
+            return;
+        }
+        if ((uintptr_t) v % align != 0) {
+            unit_failf(T, "%p not aligned to %zu", (void *) v, align);
+            return;
+        }
+        memset(v, 0xff, size);
+    }
+    unit_assert(T, dmem_alloc_aligned(m, 8, 48) == NULL);
+    unit_assert(T, dmem_alloc_aligned(m, 8, 0) == NULL);
+    unit_assert(T, dmem_alloc_aligned(m, 8, 3) == NULL);
+    unit_assert(T, dmem_alloc_aligned(m, 8, 6) == NULL);
+
+    // Padding within the current block is preferred over a new block.
+    dmem_reset(m);
+    dmem_block_t *b = ((dmem_t *) m)->blocks;
+    dmem_alloc(m, 8);
+    char *v = dmem_alloc_aligned(m, 8, 16);
+    unit_assert(T, b == ((dmem_t *) m)->blocks);
+    unit_assert(T, v >= b->origin && v < b->end);
+}
+
+void test_alloc_isolated(T_t *T, void *m)
+{
+    char *v0 = dmem_alloc_isolated(m, 4);
+    char *v1 = dmem_alloc(m, 4);
+    char *v2 = dmem_alloc_isolated(m, DMEM_CACHE_LINE + 1);
+    char *v3 = dmem_alloc(m, 4);
+    if (v0 == NULL || v1 == NULL || v2 == NULL || v3 == NULL) {
+        unit_fatal(T, "dmem_alloc_isolated() == NULL");
+    }
+    const uintptr_t lines[] = {
+        (uintptr_t) v0 / DMEM_CACHE_LINE,
+        (uintptr_t) v1 / DMEM_CACHE_LINE,
+        (uintptr_t) v2 / DMEM_CACHE_LINE,
+        ((uintptr_t) v2 + DMEM_CACHE_LINE) / DMEM_CACHE_LINE,
+        (uintptr_t) v3 / DMEM_CACHE_LINE,
+    };
+    unit_assert(T, (uintptr_t) v0 % DMEM_CACHE_LINE == 0);
+    unit_assert(T, (uintptr_t) v2 % DMEM_CACHE_LINE == 0);
+    unit_assert(T, lines[0] != lines[1]);
+    unit_assert(T, lines[2] != lines[1] && lines[3] != lines[1]);
+    unit_assert(T, lines[2] != lines[4] && lines[3] != lines[4]);
+}
+
 void assert_dmem_integrity(T_t *T, const dmem_t *m);
 
 void provider_dmem(T_t *T, unit_test_t test)
@@ -156,6 +868,18 @@ void provider_dmem(T_t *T, unit_test_t test)
     dmem_destroy(m);
 }
 
+void provider_dmem_reserved(T_t *T, unit_test_t test)
+{
+    dmem_t *m = dmem_create_reserved(64, 1 << 24, DMEM_DECOMMIT);
+    if (m == NULL) {
+        unit_skip(T, "Reserved DMEM objects not supported.");
+    }
+    assert_dmem_integrity(T, m);
+    test(T, m);
+    assert_dmem_integrity(T, m);
+    dmem_destroy(m);
+}
+
 void assert_dmem_integrity(T_t *T, const dmem_t *m)
 {
     if (m->blocks == NULL) {
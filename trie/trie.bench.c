@@ -0,0 +1,137 @@
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#include "trie.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+TRIE lookup benchmarks.
+
+Every case looks up random keys of a TRIE of some size, half of which exist,
+first using one trie_get() call per key, and then using trie_get_batch() with
+batches of BATCH keys. Results are written to stdout as CSV, with one line per
+case and method:
+
+    case,method,lookups,ns_per_op,ops_per_s
+
+The amount of rounds run may be given as the only argument.
+*/
+
+#define BATCH 256
+#define LOOKUPS (64 * BATCH)
+#define KEY_SIZE 16
+
+typedef struct {
+    const char *name;
+    size_t keys;
+} case_t;
+
+static const case_t cases[] = {
+    {"small", 1000},
+    {"medium", 100000},
+    {"large", 2000000},
+};
+
+static volatile uintptr_t sink;
+
+/*
+Writes key number i to key. Keys are of varying lengths and spread out over
+the TRIE.
+*/
+static void make_key(char *key, size_t i)
+{
+    uint64_t x = (i + 1) * 0x9e3779b97f4a7c15ull;
+    const size_t length = 6 + x % 8;
+    for (size_t j = 0; j < length; ++j) {
+        key[j] = 'a' + (x >> 8) % 26;
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+    }
+    key[length] = '\0';
+}
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static void report(const char *name, const char *method, size_t ops,
+                   double ns)
+{
+    printf("%s,%s,%zu,%.2f,%.0f\n", name, method, ops, ns / ops,
+           ops / ns * 1e9);
+}
+
+static void bench(const case_t *c, size_t rounds)
+{
+    char (*keys)[KEY_SIZE] = malloc(c->keys * 2 * KEY_SIZE);
+    const char **lookups = malloc(LOOKUPS * sizeof(char *));
+    const void **out = malloc(BATCH * sizeof(void *));
+    trie_t *t = trie_create(1024);
+    if (keys == NULL || lookups == NULL || out == NULL || t == NULL) {
+        fprintf(stderr, "%s: out of memory\n", c->name);
+        exit(1);
+    }
+    // Keys from c->keys and on are looked up but never put.
+    for (size_t i = 0; i < c->keys * 2; ++i) {
+        make_key(keys[i], i);
+        if (i < c->keys && trie_put(t, keys[i], keys[i]) == NULL) {
+            fprintf(stderr, "%s: out of memory\n", c->name);
+            exit(1);
+        }
+    }
+    uint64_t x = 88172645463325252ull;
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        lookups[i] = keys[x % (c->keys * 2)];
+    }
+
+    uintptr_t found = 0;
+    double start = now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < LOOKUPS; ++i) {
+            found += (uintptr_t) trie_get(t, lookups[i]);
+        }
+    }
+    report(c->name, "get", rounds * LOOKUPS, now() - start);
+
+    start = now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < LOOKUPS; i += BATCH) {
+            trie_get_batch(t, &lookups[i], BATCH, out);
+            for (size_t j = 0; j < BATCH; ++j) {
+                found -= (uintptr_t) out[j];
+            }
+        }
+    }
+    report(c->name, "batch", rounds * LOOKUPS, now() - start);
+    fflush(stdout);
+
+    // Both methods find the same values, which cancel out.
+    sink = found;
+    if (found != 0) {
+        fprintf(stderr, "%s: batch results differ\n", c->name);
+        exit(1);
+    }
+    trie_destroy(t);
+    free(out);
+    free(lookups);
+    free(keys);
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : 20;
+
+    printf("case,method,lookups,ns_per_op,ops_per_s\n");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        bench(&cases[i], rounds);
+    }
+    return 0;
+}
@@ -1,9 +1,34 @@
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
 #include "trie.h"
 
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define _MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#endif
+
+#ifdef __GNUC__
+#define _prefetch(address) __builtin_prefetch(address)
+#else
+#define _prefetch(address) ((void) (address))
+#endif
+
 static const unsigned EMPTY = 0;
+static const int END = -1; // Character of nodes ending keys.
 
 int _resize(trie_t *t, const unsigned size)
 {
@@ -16,20 +41,40 @@ int _resize(trie_t *t, const unsigned size)
     return 0;
 }
 
+static void _node_init(trie_node_t *node, const int c)
+{
+    node->character = c;
+    node->index_alt = EMPTY;
+    if (c == END) {
+        node->value = NULL;
+    } else {
+        node->index_next = EMPTY;
+    }
+}
+
 unsigned _new_node(trie_t *t, const int c)
 {
-    if (t->amount == t->limit) {
-        if (_resize(t, t->limit * 2) == -1) {
-            return EMPTY;
-        }
+    // Free nodes are reused before any new ones are added.
+    unsigned index = t->free;
+    if (index != EMPTY) {
+        t->free = t->nodes[index].index_alt;
+    } else if (t->amount == t->limit && _resize(t, t->limit * 2) == -1) {
+        return EMPTY;
+    } else {
+        index = t->amount++;
     }
+    _node_init(&t->nodes[index], c);
+    return index;
+}
 
-    trie_node_t *node = &t->nodes[t->amount];
-    node->character = c;
+static void _free_node(trie_t *t, const unsigned index)
+{
+    // Free nodes are left without values, as they are still saved.
+    trie_node_t *node = &t->nodes[index];
+    node->character = '\0';
     node->index_next = EMPTY;
-    node->index_alt = EMPTY;
-
-    return t->amount++;
+    node->index_alt = t->free;
+    t->free = index;
 }
 
 trie_t *trie_create(const unsigned initial_node_capacity)
@@ -40,6 +85,9 @@ trie_t *trie_create(const unsigned initial_node_capacity)
     }
     t->nodes = NULL;
     t->amount = 0;
+    t->free = EMPTY;
+    t->blob = NULL;
+    t->mapped = 0;
     if (_resize(t, initial_node_capacity) == -1) {
         free(t);
         return NULL;
@@ -48,60 +96,188 @@ trie_t *trie_create(const unsigned initial_node_capacity)
     return t;
 }
 
+static void _unmap(trie_t *t);
+
 void trie_destroy(trie_t *t)
 {
-    free(t->nodes);
+    if (t->mapped != 0) {
+        _unmap(t);
+    } else {
+        free(t->nodes);
+    }
     free(t);
 }
 
-void *_put(trie_t *t, const unsigned index, const char *k, const void *v)
+/*
+Adds the children at depth of all keys from lo to hi, which share their first
+depth characters, as consecutive nodes. Returns the first of them.
+*/
+static unsigned _build(trie_t *t, const char *const *keys,
+                       const void *const *values, size_t lo, size_t hi,
+                       size_t depth)
 {
-    trie_node_t *n = &t->nodes[index];
+    const unsigned first = t->amount;
+    for (size_t i = lo; i < hi; ++t->amount) {
+        const char c = keys[i][depth];
+        while (i < hi && keys[i][depth] == c) {
+            ++i;
+        }
+    }
+    const unsigned last = t->amount - 1;
+    for (unsigned index = first; lo < hi; ++index) {
+        const char c = keys[lo][depth];
+        size_t i = lo;
+        while (i < hi && keys[i][depth] == c) {
+            ++i;
+        }
+        trie_node_t *n = &t->nodes[index];
+        n->character = c != '\0' ? (unsigned char) c : END;
+        n->index_alt = index < last ? index + 1 : EMPTY;
+        if (c == '\0') {
+            n->value = values[i - 1];
+        } else {
+            n->index_next = _build(t, keys, values, lo, i, depth + 1);
+        }
+        lo = i;
+    }
+    return first;
+}
+
+trie_t *trie_build_sorted(const char *const *keys, const void *const *values,
+                          size_t n)
+{
+    if (n == 0) {
+        return trie_create(1);
+    }
+    // Every key adds one node per character after those it shares with the
+    // previous key, and one for its end, unless it equals the previous key.
+    size_t amount = strlen(keys[0]) + 1;
+    for (size_t i = 1; i < n; ++i) {
+        const unsigned char *a = (const unsigned char *) keys[i - 1];
+        const unsigned char *b = (const unsigned char *) keys[i];
+        size_t p = 0;
+        while (a[p] == b[p] && a[p] != '\0') {
+            ++p;
+        }
+        if (a[p] > b[p]) {
+            return NULL;
+        }
+        amount += a[p] != b[p] ? strlen(keys[i]) + 1 - p : 0;
+    }
+    if (keys[0][0] == '\0' || amount > (unsigned) -1) {
+        return NULL;
+    }
+
+    trie_t *t = trie_create(amount);
+    if (t == NULL) {
+        return NULL;
+    }
+    t->amount = 0;
+    _build(t, keys, values, 0, n, 0);
+    return t;
+}
+
+static const void *_value(const trie_t *t, const trie_node_t *n)
+{
+    // Values of TRIEs with blobs are offsets into them, plus one.
+    if (t->blob == NULL || n->value == NULL) {
+        return n->value;
+    }
+    return &t->blob[(uintptr_t) n->value - 1];
+}
+
+/*
+Length of keys ending at their first '\0'. No key of bytes can be this long.
+*/
+#define _STRING SIZE_MAX
 
-    if (*k == '\0') {
-        n->value = v;
-        return (void *) v;
+/*
+Returns the character of the node matching the next of len bytes at k, or END
+if no bytes remain.
+*/
+static int _key_char(const unsigned char *k, const size_t len)
+{
+    if (len == _STRING) {
+        return *k != '\0' ? *k : END;
     }
-    if (n->character == *k) {
+    return len != 0 ? *k : END;
+}
+
+/*
+Returns the length of the key remaining after its next byte.
+*/
+static size_t _key_rest(const size_t len)
+{
+    return len != _STRING ? len - 1 : len;
+}
+
+/*
+Returns the character of the node matching the next character of string k.
+*/
+static int _string_char(const char *k)
+{
+    return *k != '\0' ? (unsigned char) *k : END;
+}
+
+void *_put(trie_t *t, const unsigned index, const unsigned char *k,
+           const size_t len, const void *v)
+{
+    trie_node_t *n = &t->nodes[index];
+    const int c = _key_char(k, len);
+
+    if (n->character == c) {
+        if (c == END) {
+            n->value = v;
+            return (void *) v;
+        }
         if (n->index_next == EMPTY) {
-            unsigned index_next = _new_node(t, k[1]);
+            unsigned index_next = _new_node(t, _key_char(&k[1], _key_rest(len)));
             if (index_next == EMPTY) return NULL;
             t->nodes[index].index_next = index_next;
         }
-        return _put(t, t->nodes[index].index_next, &k[1], v);
+        return _put(t, t->nodes[index].index_next, &k[1], _key_rest(len), v);
 
     } else {
         if (n->index_alt == EMPTY) {
-            unsigned index_alt = _new_node(t, *k);
+            unsigned index_alt = _new_node(t, c);
             if (index_alt == EMPTY) return NULL;
             t->nodes[index].index_alt = index_alt;
         }
-        return _put(t, t->nodes[index].index_alt, k, v);
+        return _put(t, t->nodes[index].index_alt, k, len, v);
     }
 }
 
 void *trie_put(trie_t *t, const char *key, const void *value)
 {
-    if (key[0] == '\0') {
+    if (key[0] == '\0' || t->mapped != 0) {
+        return NULL;
+    }
+    return _put(t, 0, (const unsigned char *) key, _STRING, value);
+}
+
+void *trie_put_bytes(trie_t *t, const void *key, size_t len,
+                     const void *value)
+{
+    if (len == 0 || t->mapped != 0) {
         return NULL;
     }
-    return _put(t, 0, key, value);
+    return _put(t, 0, key, len, value);
 }
 
-void *_get(const trie_t *t, unsigned index, const char *k)
+void *_get(const trie_t *t, unsigned index, const unsigned char *k,
+           size_t len)
 {
     trie_node_t *n = &t->nodes[index];
+    const int c = _key_char(k, len);
 
-    if (*k == '\0') {
-        return (void *) n->value;
-    }
-    if (n->character == *k) {
+    if (n->character == c) {
+        if (c == END) return (void *) _value(t, n);
         if (n->index_next == EMPTY) return NULL;
-        return _get(t, n->index_next, &k[1]);
+        return _get(t, n->index_next, &k[1], _key_rest(len));
 
     } else {
         if (n->index_alt == EMPTY) return NULL;
-        return _get(t, n->index_alt, k);
+        return _get(t, n->index_alt, k, len);
     }
 }
 
@@ -110,7 +286,204 @@ void *trie_get(const trie_t *t, const char *key)
     if (key[0] == '\0') {
         return NULL;
     }
-    return _get(t, 0, key);
+    return _get(t, 0, (const unsigned char *) key, _STRING);
+}
+
+void *trie_get_bytes(const trie_t *t, const void *key, size_t len)
+{
+    if (len == 0) {
+        return NULL;
+    }
+    return _get(t, 0, key, len);
+}
+
+/*
+Lookup in progress within a batch, at node index with key remaining.
+*/
+typedef struct {
+    const char *key;
+    unsigned index;
+    size_t slot;
+} _lookup_t;
+
+#define _BATCH_LOOKUPS 16
+
+/*
+Writes NULL for the empty keys from next and on. Returns the first key which
+is not empty, or n.
+*/
+static size_t _batch_skip(const char *const *keys, size_t n, size_t next,
+                          const void **out)
+{
+    for (; next < n && keys[next][0] == '\0'; ++next) {
+        out[next] = NULL;
+    }
+    return next;
+}
+
+void trie_get_batch(const trie_t *t, const char *const *keys, size_t n,
+                    const void **out)
+{
+    // Lookups take one step each in turn. Every step prefetches the node of
+    // the next one, which then has until the turn comes back to arrive.
+    _lookup_t lookups[_BATCH_LOOKUPS];
+    size_t active = 0, next = _batch_skip(keys, n, 0, out);
+    for (; active < _BATCH_LOOKUPS && next < n; ++active) {
+        out[next] = NULL;
+        lookups[active] = (_lookup_t) {keys[next], 0, next};
+        next = _batch_skip(keys, n, next + 1, out);
+    }
+    while (active > 0) {
+        for (size_t i = 0; i < active;) {
+            _lookup_t *l = &lookups[i];
+            const trie_node_t *node = &t->nodes[l->index];
+            const int c = _string_char(l->key);
+            unsigned index;
+            if (node->character != c) {
+                index = node->index_alt;
+            } else if (c != END) {
+                index = node->index_next;
+                ++l->key;
+            } else {
+                out[l->slot] = _value(t, node);
+                index = EMPTY;
+            }
+            if (index != EMPTY) {
+                l->index = index;
+                _prefetch(&t->nodes[index]);
+                ++i;
+            } else if (next < n) {
+                // The lookup is done, and is replaced by the next one.
+                out[next] = NULL;
+                *l = (_lookup_t) {keys[next], 0, next};
+                next = _batch_skip(keys, n, next + 1, out);
+                ++i;
+            } else {
+                *l = lookups[--active];
+            }
+        }
+    }
+}
+
+/*
+Removes key from the chain at head, and returns the new head of the chain,
+which is EMPTY if no nodes remain. Nodes left without children are removed.
+The value of the key is written to value, if it is found.
+*/
+static unsigned _remove(trie_t *t, const unsigned head, const unsigned char *k,
+                        const size_t len, const void **value)
+{
+    const int c = _key_char(k, len);
+    unsigned *link = NULL, index = head;
+    while (t->nodes[index].character != c) {
+        if (t->nodes[index].index_alt == EMPTY) {
+            return head;
+        }
+        link = &t->nodes[index].index_alt;
+        index = *link;
+    }
+
+    trie_node_t *n = &t->nodes[index];
+    if (c == END) {
+        *value = _value(t, n);
+    } else if (n->index_next == EMPTY) {
+        return head;
+    } else {
+        n->index_next = _remove(t, n->index_next, &k[1], _key_rest(len),
+                                value);
+        if (n->index_next != EMPTY) {
+            return head;
+        }
+    }
+
+    // The first node of the TRIE cannot be moved, and is therefore replaced
+    // by its alternative, if any.
+    const unsigned index_alt = n->index_alt;
+    if (index == 0) {
+        if (index_alt != EMPTY) {
+            *n = t->nodes[index_alt];
+            _free_node(t, index_alt);
+        }
+        return head;
+    }
+    _free_node(t, index);
+    if (link == NULL) {
+        return index_alt;
+    }
+    *link = index_alt;
+    return head;
+}
+
+void *trie_remove(trie_t *t, const char *key)
+{
+    const void *value = NULL;
+    if (key[0] == '\0' || t->mapped != 0) {
+        return NULL;
+    }
+    _remove(t, 0, (const unsigned char *) key, _STRING, &value);
+    return (void *) value;
+}
+
+void *trie_remove_bytes(trie_t *t, const void *key, size_t len)
+{
+    const void *value = NULL;
+    if (len == 0 || t->mapped != 0) {
+        return NULL;
+    }
+    _remove(t, 0, key, len, &value);
+    return (void *) value;
+}
+
+/*
+Copies the live nodes of the chain at head to consecutive nodes from amount
+and on, followed by their children. Returns the first of them.
+*/
+static unsigned _compact(const trie_t *t, trie_node_t *nodes, unsigned *amount,
+                         const unsigned head)
+{
+    const unsigned first = *amount;
+    for (unsigned i = head;; i = t->nodes[i].index_alt) {
+        const trie_node_t *n = &t->nodes[i];
+        if (n->character == END || n->index_next != EMPTY) {
+            nodes[(*amount)++] = *n;
+        }
+        if (n->index_alt == EMPTY) {
+            break;
+        }
+    }
+    // Only the first chain of an empty TRIE is without live nodes.
+    if (*amount == first) {
+        nodes[(*amount)++] = t->nodes[head];
+    }
+    const unsigned last = *amount - 1;
+    for (unsigned i = first; i <= last; ++i) {
+        nodes[i].index_alt = i < last ? i + 1 : EMPTY;
+        if (nodes[i].character != END && nodes[i].index_next != EMPTY) {
+            nodes[i].index_next = _compact(t, nodes, amount,
+                                           nodes[i].index_next);
+        }
+    }
+    return first;
+}
+
+int trie_compact(trie_t *t)
+{
+    if (t->mapped != 0) {
+        return -1;
+    }
+    trie_node_t *nodes = malloc(t->amount * sizeof(trie_node_t));
+    if (nodes == NULL) {
+        return -1;
+    }
+    unsigned amount = 0;
+    _compact(t, nodes, &amount, 0);
+    free(t->nodes);
+    t->nodes = nodes;
+    t->amount = amount;
+    t->limit = amount;
+    t->free = EMPTY;
+    _resize(t, amount); // Shrinking fails only if the memory is kept.
+    return 0;
 }
 
 /*
@@ -154,43 +527,70 @@ int _string_append(_string_t *str, char c)
     return 0;
 }
 
-int _suggest(const trie_t *t, unsigned index, const char *k, _string_t *r)
+int _suggest(const trie_t *t, unsigned index, const unsigned char *k,
+             size_t len, _string_t *r)
 {
-    const trie_node_t *n = &t->nodes[index];
-
-    if (n->character == '\0') {
-        return _string_append(r, '\0');
-    }
-    if (*k == '\0') {
-        if (_string_append(r, n->character) == -1) return -1;
-        return _suggest(t, n->index_next, k, r);
+    // Follows the node matching the key, if any. Otherwise, the key is ended
+    // if possible, or else completed by the first node if the key is at its
+    // end, or by the last node if not.
+    const int c = _key_char(k, len);
+    const trie_node_t *n = NULL, *end = NULL, *first = NULL, *last = NULL;
+    for (unsigned i = index;; i = t->nodes[i].index_alt) {
+        const trie_node_t *m = &t->nodes[i];
+        if (m->character == c && (c == END || m->index_next != EMPTY)) {
+            n = m;
+            break;
+        }
+        if (m->character == END) {
+            end = m;
+        } else if (m->index_next != EMPTY) {
+            first = first != NULL ? first : m;
+            last = m;
+        }
+        if (m->index_alt == EMPTY) {
+            break;
+        }
     }
-    if (n->character == *k) {
-        if (_string_append(r, n->character) == -1) return -1;
-        return _suggest(t, n->index_next, &k[1], r);
+    if (n == NULL) {
+        n = end != NULL ? end : c == END ? first : last;
+    } else if (c != END) {
+        ++k;
+        --len;
     }
-    if (n->index_alt == EMPTY) {
-        if (_string_append(r, n->character) == -1) return -1;
-        return _suggest(t, n->index_next, k, r);
+    if (n == NULL || n->character == END) {
+        return _string_append(r, '\0');
     }
-    return _suggest(t, n->index_alt, k, r);
+    if (_string_append(r, n->character) == -1) return -1;
+    return _suggest(t, n->index_next, k, len, r);
 }
 
 char *trie_suggest(const trie_t *t, const char *key)
+{
+    return trie_suggest_bytes(t, key, strlen(key), NULL);
+}
+
+void *trie_suggest_bytes(const trie_t *t, const void *key, size_t len,
+                         size_t *size)
 {
     _string_t result;
     if (_string_alloc(&result, 16) == -1) {
         return NULL;
     }
-    if (_suggest(t, 0, key, &result) == -1) {
+    if (_suggest(t, 0, key, len, &result) == -1) {
         free(result.origin);
         return NULL;
     }
+    if (size != NULL) {
+        *size = result.offset - result.origin - 1;
+    }
     return result.origin;
 }
 
 trie_t *trie_copy(const trie_t *t, trie_t *target)
 {
+    if (target->mapped != 0) {
+        return NULL;
+    }
     if (target->limit < t->amount) {
         if (_resize(target, t->amount) == -1) {
             return NULL;
@@ -198,5 +598,1160 @@ trie_t *trie_copy(const trie_t *t, trie_t *target)
     }
     memcpy(target->nodes, t->nodes, t->amount * sizeof(trie_node_t));
     target->amount = t->amount;
+    target->free = t->free;
+    target->blob = NULL;
+
+    // Blob offsets are turned into pointers, which later puts also store.
+    if (t->blob != NULL) {
+        for (unsigned i = 0; i < t->amount; ++i) {
+            trie_node_t *n = &target->nodes[i];
+            if (n->character == END) {
+                n->value = _value(t, &t->nodes[i]);
+            }
+        }
+    }
     return target;
 }
+
+/*
+TRIE image header. The nodes follow at _IMAGE_NODES, and the value blob at
+blob_offset.
+*/
+typedef struct {
+    char magic[8];
+    uint32_t version, order, node_size, reserved;
+    uint64_t amount, blob_offset, blob_size;
+} _image_header_t;
+
+#define _IMAGE_MAGIC "TRIEIMG"
+#define _IMAGE_VERSION 2
+#define _IMAGE_NODES 64
+
+static void _image_header_init(_image_header_t *h, const uint64_t amount,
+                               const uint64_t blob_size)
+{
+    memset(h, 0, sizeof(_image_header_t));
+    memcpy(h->magic, _IMAGE_MAGIC, sizeof(_IMAGE_MAGIC));
+    h->version = _IMAGE_VERSION;
+    h->order = 0x01020304;
+    h->node_size = sizeof(trie_node_t);
+    h->amount = amount;
+    h->blob_offset = _IMAGE_NODES + amount * sizeof(trie_node_t);
+    h->blob_size = blob_size;
+}
+
+static int _save_nodes(const trie_t *t, FILE *f, const void *blob,
+                       size_t blob_size)
+{
+    trie_node_t nodes[256];
+    for (unsigned i = 0; i < t->amount; i += 256) {
+        const unsigned n = t->amount - i < 256 ? t->amount - i : 256;
+        memcpy(nodes, &t->nodes[i], n * sizeof(trie_node_t));
+        for (unsigned j = 0; j < n; ++j) {
+            if (nodes[j].character != END || blob == NULL) {
+                continue;
+            }
+            const uintptr_t v = (uintptr_t) _value(t, &t->nodes[i + j]);
+            if (v == 0) {
+                continue;
+            }
+            if (v < (uintptr_t) blob || v >= (uintptr_t) blob + blob_size) {
+                return -1;
+            }
+            nodes[j].value = (const void *) (v - (uintptr_t) blob + 1);
+        }
+        if (fwrite(nodes, sizeof(trie_node_t), n, f) != n) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int trie_save(const trie_t *t, const char *path, const void *blob,
+              size_t blob_size)
+{
+    if (blob == NULL && t->blob != NULL) {
+        return -1;
+    }
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+    static const char padding[_IMAGE_NODES] = {0};
+    blob_size = blob != NULL ? blob_size : 0;
+
+    _image_header_t h;
+    _image_header_init(&h, t->amount, blob_size);
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1
+             && fwrite(padding, _IMAGE_NODES - sizeof(h), 1, f) == 1
+             && _save_nodes(t, f, blob, blob_size) == 0
+             && (blob_size == 0 || fwrite(blob, blob_size, 1, f) == 1);
+    if (fclose(f) != 0) {
+        ok = 0;
+    }
+    return ok ? 0 : -1;
+}
+
+static trie_t *_open(char *base, const size_t size, const void **blob,
+                     size_t *blob_size)
+{
+    const _image_header_t *h = (const _image_header_t *) base;
+    _image_header_t expected;
+    _image_header_init(&expected, h->amount, h->blob_size);
+    if (memcmp(h, &expected, sizeof(_image_header_t)) != 0
+            || h->amount == 0 || h->amount > (unsigned) -1
+            || h->blob_offset > size || h->blob_size > size - h->blob_offset) {
+        return NULL;
+    }
+    trie_t *t = malloc(sizeof(trie_t));
+    if (t == NULL) {
+        return NULL;
+    }
+    t->nodes = (trie_node_t *) &base[_IMAGE_NODES];
+    t->amount = h->amount;
+    t->limit = h->amount;
+    t->free = EMPTY;
+    t->blob = h->blob_size != 0 ? &base[h->blob_offset] : NULL;
+    t->mapped = size;
+    if (blob != NULL) {
+        *blob = t->blob;
+        *blob_size = h->blob_size;
+    }
+    return t;
+}
+
+trie_t *trie_open_mmap(const char *path, const void **blob, size_t *blob_size)
+{
+#ifdef _MMAP
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < _IMAGE_NODES) {
+        close(fd);
+        return NULL;
+    }
+    char *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    trie_t *t = _open(base, st.st_size, blob, blob_size);
+    if (t == NULL) {
+        munmap(base, st.st_size);
+    }
+    return t;
+#else
+    return NULL;
+#endif
+}
+
+static void _unmap(trie_t *t)
+{
+#ifdef _MMAP
+    munmap((char *) t->nodes - _IMAGE_NODES, t->mapped);
+#endif
+}
+
+static const unsigned NONE = (unsigned) -1;
+
+/*
+Ranks nodes in key order. Terminal nodes come first, and nodes without any
+children are not ranked, as they are not part of any key.
+*/
+static int _rank(const trie_node_t *n)
+{
+    if (n->character == END) {
+        return 0;
+    }
+    return n->index_next != EMPTY ? 1 + n->character : -1;
+}
+
+/*
+Returns the node of the chain at head with the lowest rank above given rank, or
+NONE.
+*/
+static unsigned _cursor_min(const trie_t *t, unsigned head, const int above)
+{
+    unsigned min = NONE;
+    int min_rank = 257;
+    for (unsigned i = head;; i = t->nodes[i].index_alt) {
+        const int rank = _rank(&t->nodes[i]);
+        if (rank > above && rank < min_rank) {
+            min = i;
+            min_rank = rank;
+        }
+        if (t->nodes[i].index_alt == EMPTY) {
+            return min;
+        }
+    }
+}
+
+/*
+Finds the node at which the first key after the length bytes of key leaves it,
+considering the chain at head to hold the children of the first depth bytes of
+key. Returns that node, or NONE, and writes its depth to at.
+*/
+static unsigned _cursor_after(const trie_t *t, unsigned head, const char *key,
+                              size_t length, size_t depth, size_t *at)
+{
+    const int rank = depth < length ? 1 + (unsigned char) key[depth] : 0;
+    if (rank != 0) {
+        for (unsigned i = head;; i = t->nodes[i].index_alt) {
+            if (_rank(&t->nodes[i]) == rank) {
+                const unsigned n = _cursor_after(t, t->nodes[i].index_next,
+                                                 key, length, depth + 1, at);
+                if (n != NONE) {
+                    return n;
+                }
+                break;
+            }
+            if (t->nodes[i].index_alt == EMPTY) {
+                break;
+            }
+        }
+    }
+    *at = depth;
+    return _cursor_min(t, head, rank);
+}
+
+int trie_cursor_init(trie_cursor_t *c, const trie_t *t, const char *prefix,
+                     char *buffer, size_t size)
+{
+    const size_t length = strlen(prefix);
+    if (length >= size) {
+        return -1;
+    }
+    memcpy(buffer, prefix, length + 1);
+    c->trie = t;
+    c->key = buffer;
+    c->size = size;
+    c->prefix = length;
+    c->length = length;
+    c->head = 0;
+    c->state = 0;
+    for (size_t i = 0; i < length; ++i) {
+        unsigned j = c->head;
+        while (_rank(&t->nodes[j]) != 1 + (unsigned char) prefix[i]) {
+            j = t->nodes[j].index_alt;
+            if (j == EMPTY) {
+                c->head = NONE;
+                c->state = -1;
+                return 0;
+            }
+        }
+        c->head = t->nodes[j].index_next;
+    }
+    return 0;
+}
+
+int trie_cursor_seek(trie_cursor_t *c, const char *key)
+{
+    const size_t length = strlen(key);
+    if (length >= c->size) {
+        return -1;
+    }
+    if (c->head == NONE) {
+        return 0;
+    }
+    const int order = strncmp(key, c->key, c->prefix);
+    if (order == 0) {
+        memcpy(c->key, key, length + 1);
+        c->length = length;
+    }
+    c->state = order < 0 ? 0 : order > 0 ? -1 : 1;
+    return 0;
+}
+
+int trie_cursor_next(trie_cursor_t *c, const void **value)
+{
+    if (c->state == -1) {
+        return 0;
+    }
+    const trie_t *t = c->trie;
+    size_t at = c->prefix;
+    unsigned n = c->state == 0
+                 ? _cursor_min(t, c->head, -1)
+                 : _cursor_after(t, c->head, c->key, c->length, c->prefix,
+                                 &at);
+
+    // The rest of the key is made of the first children from n and on, which
+    // are counted before anything is written.
+    size_t length = at;
+    unsigned m = n;
+    while (m != NONE && t->nodes[m].character != END) {
+        m = _cursor_min(t, t->nodes[m].index_next, -1);
+        ++length;
+    }
+    if (n == NONE || m == NONE) {
+        c->state = -1;
+        return 0;
+    }
+    if (length >= c->size) {
+        return -1;
+    }
+    for (; t->nodes[n].character != END; ++at) {
+        c->key[at] = t->nodes[n].character;
+        n = _cursor_min(t, t->nodes[n].index_next, -1);
+    }
+    c->key[at] = '\0';
+    c->length = at;
+    *value = _value(t, &t->nodes[n]);
+    c->state = 1;
+    return 1;
+}
+
+/*
+Child of a node being packed, and the first node of its own children.
+*/
+typedef struct {
+    unsigned char label;
+    unsigned head;
+} _child_t;
+
+static int _labels_reserve(trie_packed_t *p, unsigned *capacity,
+                           const unsigned size)
+{
+    // SIMD loads may read up to TRIE_PACKED_SPARSE bytes past the last label.
+    unsigned c = *capacity != 0 ? *capacity : 256;
+    while (c < size + TRIE_PACKED_SPARSE) {
+        c *= 2;
+    }
+    if (c == *capacity) {
+        return 0;
+    }
+    unsigned char *mem = realloc(p->labels, c);
+    if (mem == NULL) {
+        return -1;
+    }
+    memset(&mem[*capacity], 0, c - *capacity);
+    p->labels = mem;
+    *capacity = c;
+    return 0;
+}
+
+static unsigned _pack_children(const trie_t *t, unsigned head,
+                               const void **value, _child_t *children)
+{
+    unsigned count = 0;
+    for (unsigned i = head;; i = t->nodes[i].index_alt) {
+        const trie_node_t *n = &t->nodes[i];
+        if (n->character == END) {
+            *value = _value(t, n);
+
+        } else if (n->character != '\0' && n->index_next != EMPTY) {
+            // Children are sorted by label as they are added.
+            _child_t c = {(unsigned char) n->character, n->index_next};
+            unsigned j = count++;
+            for (; j > 0 && children[j - 1].label > c.label; --j) {
+                children[j] = children[j - 1];
+            }
+            children[j] = c;
+        }
+        if (n->index_alt == EMPTY) {
+            return count;
+        }
+    }
+}
+
+static int _pack(const trie_t *t, trie_packed_t *p, unsigned *heads)
+{
+    // Packed nodes are given the first node of the chain of their children,
+    // of which the root has the chain starting at node zero.
+    unsigned capacity = 0, size = 1;
+    if (_labels_reserve(p, &capacity, size) == -1) {
+        return -1;
+    }
+    heads[0] = 0;
+    for (unsigned i = 0; i < p->amount; ++i) {
+        _child_t children[256];
+        trie_packed_node_t *n = &p->nodes[i];
+        n->value = NULL;
+        const unsigned count = _pack_children(t, heads[i], &n->value, children);
+
+        n->child = p->amount;
+        n->labels = 0; // The count of the first labels is always zero.
+        if (count == 0) {
+            continue;
+        }
+        const unsigned span = count > TRIE_PACKED_SPARSE ? 256 : count;
+        if (_labels_reserve(p, &capacity, size + 1 + span) == -1) {
+            return -1;
+        }
+        unsigned char *labels = &p->labels[size];
+        labels[0] = count;
+        for (unsigned j = 0; j < count; ++j) {
+            if (count > TRIE_PACKED_SPARSE) {
+                labels[1 + children[j].label] = j + 1;
+            } else {
+                labels[1 + j] = children[j].label;
+            }
+            heads[p->amount++] = children[j].head;
+        }
+        n->labels = size;
+        size += 1 + span;
+    }
+    return 0;
+}
+
+trie_packed_t *trie_pack(const trie_t *t)
+{
+    trie_packed_t *p = malloc(sizeof(trie_packed_t));
+    if (p == NULL) {
+        return NULL;
+    }
+    p->nodes = malloc((t->amount + 1) * sizeof(trie_packed_node_t));
+    p->labels = NULL;
+    p->amount = 1;
+
+    unsigned *heads = malloc((t->amount + 1) * sizeof(unsigned));
+    if (p->nodes == NULL || heads == NULL || _pack(t, p, heads) == -1) {
+        free(heads);
+        trie_packed_destroy(p);
+        return NULL;
+    }
+    free(heads);
+    return p;
+}
+
+void trie_packed_destroy(trie_packed_t *p)
+{
+    free(p->nodes);
+    free(p->labels);
+    free(p);
+}
+
+/*
+Returns the index of label c among the count first labels, or -1 if missing.
+*/
+static int _find_sparse(const unsigned char *labels, unsigned count,
+                        unsigned char c)
+{
+#if defined(__GNUC__) && defined(__AVX2__)
+    const __m256i v = _mm256_loadu_si256((const __m256i *) labels);
+    const __m256i eq = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+    const unsigned long long mask = (unsigned) _mm256_movemask_epi8(eq)
+                                    & ((1ull << count) - 1);
+    return mask != 0 ? __builtin_ctzll(mask) : -1;
+#elif defined(__GNUC__) && defined(__SSE2__)
+    const __m128i x = _mm_set1_epi8(c);
+    const __m128i v0 = _mm_loadu_si128((const __m128i *) labels);
+    const __m128i v1 = _mm_loadu_si128((const __m128i *) &labels[16]);
+    const unsigned long long mask =
+        ((unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v0, x))
+         | (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v1, x)) << 16)
+        & ((1ull << count) - 1);
+    return mask != 0 ? __builtin_ctzll(mask) : -1;
+#else
+    for (unsigned i = 0; i < count && labels[i] <= c; ++i) {
+        if (labels[i] == c) {
+            return i;
+        }
+    }
+    return -1;
+#endif
+}
+
+void *trie_packed_get(const trie_packed_t *p, const char *key)
+{
+    if (key[0] == '\0') {
+        return NULL;
+    }
+    unsigned i = 0;
+    for (const unsigned char *k = (const unsigned char *) key; *k; ++k) {
+        const trie_packed_node_t *n = &p->nodes[i];
+        const unsigned char *labels = &p->labels[n->labels];
+        const int j = labels[0] > TRIE_PACKED_SPARSE
+                      ? labels[1 + *k] - 1
+                      : _find_sparse(&labels[1], labels[0], *k);
+        if (j == -1) {
+            return NULL;
+        }
+        i = n->child + j;
+    }
+    return (void *) p->nodes[i].value;
+}
+
+/*
+Frozen TRIE being built. Each slot links to itself if free, or towards the
+next free slot otherwise. Free slots more than _FREEZE_WINDOW slots below the
+highest used one are no longer considered, as they are unlikely to fit.
+*/
+typedef struct {
+    trie_frozen_t *f;
+    unsigned *free;
+    unsigned capacity, values, top;
+} _freezer_t;
+
+#define _FREEZE_WINDOW 4096
+
+static int _freezer_reserve(_freezer_t *z, const unsigned size)
+{
+    unsigned c = z->capacity != 0 ? z->capacity : 1024;
+    while (c < size) {
+        c *= 2;
+    }
+    if (c == z->capacity) {
+        return 0;
+    }
+    int *base = realloc(z->f->base, c * sizeof(int));
+    if (base == NULL) {
+        return -1;
+    }
+    z->f->base = base;
+    int *check = realloc(z->f->check, c * sizeof(int));
+    if (check == NULL) {
+        return -1;
+    }
+    z->f->check = check;
+    unsigned *free = realloc(z->free, c * sizeof(unsigned));
+    if (free == NULL) {
+        return -1;
+    }
+    z->free = free;
+    for (unsigned i = z->capacity; i < c; ++i) {
+        base[i] = 0;
+        check[i] = -1;
+        free[i] = i;
+    }
+    z->capacity = c;
+    return 0;
+}
+
+/*
+Returns the first free slot at or after slot i, or zero in case of memory
+allocation failure.
+*/
+static unsigned _freezer_next_free(_freezer_t *z, unsigned i)
+{
+    unsigned j = i;
+    for (;;) {
+        if (j >= z->capacity && _freezer_reserve(z, j + 1) == -1) {
+            return 0;
+        }
+        if (z->free[j] == j) {
+            break;
+        }
+        j = z->free[j];
+    }
+    while (i != j) {
+        const unsigned next = z->free[i];
+        z->free[i] = j;
+        i = next;
+    }
+    return j;
+}
+
+/*
+Finds base at which a free slot exists for every code, where code zero is the
+terminal slot, and makes sure that the slots of all bytes after it exist.
+*/
+static int _freeze_base(_freezer_t *z, const unsigned *codes, const unsigned n)
+{
+    unsigned p = z->top > _FREEZE_WINDOW ? z->top - _FREEZE_WINDOW : 0;
+    p = p > codes[0] ? p : codes[0];
+    for (;;) {
+        p = _freezer_next_free(z, p + 1);
+        if (p == 0 || _freezer_reserve(z, p - codes[0] + 257) == -1) {
+            return -1;
+        }
+        const unsigned b = p - codes[0];
+        unsigned i = 1;
+        while (i < n && z->f->check[b + codes[i]] == -1) {
+            ++i;
+        }
+        if (i == n) {
+            return b;
+        }
+    }
+}
+
+static int _freeze(const trie_t *t, _freezer_t *z, unsigned *states,
+                   unsigned *heads)
+{
+    trie_frozen_t *f = z->f;
+    if (_freezer_reserve(z, 257) == -1) {
+        return -1;
+    }
+    f->size = 257;
+    states[0] = 0;
+    heads[0] = 0;
+    for (unsigned i = 0, amount = 1; i < amount; ++i) {
+        _child_t children[256];
+        unsigned codes[257];
+        const void *value = NULL;
+        const unsigned count = _pack_children(t, heads[i], &value, children);
+
+        unsigned n = 0;
+        if (value != NULL) {
+            codes[n++] = 0;
+        }
+        for (unsigned j = 0; j < count; ++j) {
+            codes[n++] = children[j].label;
+        }
+        if (n == 0) {
+            continue;
+        }
+        const int b = _freeze_base(z, codes, n);
+        if (b == -1) {
+            return -1;
+        }
+        const unsigned s = states[i];
+        f->base[s] = b;
+        for (unsigned j = 0; j < n; ++j) {
+            f->check[b + codes[j]] = s;
+            z->free[b + codes[j]] = b + codes[j] + 1;
+        }
+        if (z->top < b + codes[n - 1]) {
+            z->top = b + codes[n - 1];
+        }
+        if (value != NULL) {
+            f->base[b] = z->values;
+            f->values[z->values++] = value;
+        }
+        for (unsigned j = 0; j < count; ++j) {
+            states[amount] = b + children[j].label;
+            heads[amount++] = children[j].head;
+        }
+        if (f->size < b + 257u) {
+            f->size = b + 257;
+        }
+    }
+    return 0;
+}
+
+trie_frozen_t *trie_freeze(const trie_t *t)
+{
+    trie_frozen_t *f = malloc(sizeof(trie_frozen_t));
+    if (f == NULL) {
+        return NULL;
+    }
+    f->base = NULL;
+    f->check = NULL;
+    f->values = malloc((t->amount + 1) * sizeof(void *));
+    f->size = 0;
+
+    // Each node of the TRIE becomes at most one state.
+    _freezer_t z = {f, NULL, 0, 0, 0};
+    unsigned *states = malloc((t->amount + 1) * sizeof(unsigned));
+    unsigned *heads = malloc((t->amount + 1) * sizeof(unsigned));
+    const int ok = f->values != NULL && states != NULL && heads != NULL
+                   && _freeze(t, &z, states, heads) == 0;
+    free(states);
+    free(heads);
+    free(z.free);
+    if (!ok) {
+        trie_frozen_destroy(f);
+        return NULL;
+    }
+    return f;
+}
+
+void trie_frozen_destroy(trie_frozen_t *f)
+{
+    free(f->base);
+    free(f->check);
+    free(f->values);
+    free(f);
+}
+
+void *trie_frozen_get(const trie_frozen_t *f, const char *key)
+{
+    if (key[0] == '\0') {
+        return NULL;
+    }
+    int s = 0;
+    for (const unsigned char *k = (const unsigned char *) key; *k; ++k) {
+        const int next = f->base[s] + *k;
+        if (f->check[next] != s) {
+            return NULL;
+        }
+        s = next;
+    }
+    const int end = f->base[s];
+    return f->check[end] == s ? (void *) f->values[f->base[end]] : NULL;
+}
+
+char *trie_frozen_suggest(const trie_frozen_t *f, const char *key)
+{
+    _string_t result;
+    if (_string_alloc(&result, 16) == -1) {
+        return NULL;
+    }
+    const unsigned char *k = (const unsigned char *) key;
+    for (int s = 0;;) {
+        const int b = f->base[s];
+        int c = *k;
+        if (c != 0 && f->check[b + c] == s) {
+            ++k;
+        } else if (f->check[b] != s) {
+            c = 1;
+            while (c < 256 && f->check[b + c] != s) {
+                ++c;
+            }
+        }
+        if (c == 256 || f->check[b + c] != s) {
+            c = 0;
+        }
+        if (_string_append(&result, c) == -1) {
+            free(result.origin);
+            return NULL;
+        }
+        if (c == 0) {
+            return result.origin;
+        }
+        s = b + c;
+    }
+}
+
+static int _radix_resize(trie_radix_t *t, const unsigned size)
+{
+    trie_radix_node_t *mem = realloc(t->nodes,
+                                     size * sizeof(trie_radix_node_t));
+    if (mem == NULL) {
+        return -1;
+    }
+    t->nodes = mem;
+    t->limit = size;
+    return 0;
+}
+
+static const char *_radix_label(const trie_radix_t *t,
+                                const trie_radix_node_t *n)
+{
+    return n->length > TRIE_RADIX_INLINE
+           ? &t->labels[n->label.offset]
+           : n->label.chars;
+}
+
+/*
+Adds label of given length to the pool, returning its offset, or -1 in case of
+memory allocation failure.
+*/
+static long _radix_pool(trie_radix_t *t, const char *label,
+                        const unsigned length)
+{
+    if (t->labels_limit - t->labels_size < length) {
+        unsigned limit = t->labels_limit != 0 ? t->labels_limit * 2 : 256;
+        while (limit - t->labels_size < length) {
+            limit *= 2;
+        }
+        char *mem = realloc(t->labels, limit);
+        if (mem == NULL) {
+            return -1;
+        }
+        t->labels = mem;
+        t->labels_limit = limit;
+    }
+    memcpy(&t->labels[t->labels_size], label, length);
+    t->labels_size += length;
+    return t->labels_size - length;
+}
+
+static unsigned _radix_new_node(trie_radix_t *t, const char *label,
+                                const unsigned length, const void *value)
+{
+    if (t->amount == t->limit) {
+        if (_radix_resize(t, t->limit * 2) == -1) {
+            return EMPTY;
+        }
+    }
+    trie_radix_node_t *node = &t->nodes[t->amount];
+    if (length > TRIE_RADIX_INLINE) {
+        const long offset = _radix_pool(t, label, length);
+        if (offset == -1) {
+            return EMPTY;
+        }
+        node->label.offset = offset;
+    } else {
+        memcpy(node->label.chars, label, length);
+    }
+    node->length = length;
+    node->index_next = EMPTY;
+    node->index_alt = EMPTY;
+    node->value = value;
+
+    return t->amount++;
+}
+
+trie_radix_t *trie_radix_create(const unsigned initial_node_capacity)
+{
+    trie_radix_t *t = malloc(sizeof(trie_radix_t));
+    if (t == NULL) {
+        return NULL;
+    }
+    t->nodes = NULL;
+    t->amount = 0;
+    t->labels = NULL;
+    t->labels_size = 0;
+    t->labels_limit = 0;
+    if (_radix_resize(t, initial_node_capacity > 0 ? initial_node_capacity : 1)
+            == -1) {
+        free(t);
+        return NULL;
+    }
+    _radix_new_node(t, "", 0, NULL); // The root has an empty label.
+    return t;
+}
+
+void trie_radix_destroy(trie_radix_t *t)
+{
+    free(t->nodes);
+    free(t->labels);
+    free(t);
+}
+
+/*
+Returns the child of node at index whose label starts with c, or EMPTY.
+*/
+static unsigned _radix_child(const trie_radix_t *t, unsigned index,
+                             const char c)
+{
+    unsigned i = t->nodes[index].index_next;
+    while (i != EMPTY && _radix_label(t, &t->nodes[i])[0] != c) {
+        i = t->nodes[i].index_alt;
+    }
+    return i;
+}
+
+/*
+Splits node at index after length characters of its label, moving the rest of
+the label, the value and the children into a new only child. Returns the new
+child, or EMPTY in case of memory allocation failure.
+*/
+static unsigned _radix_split(trie_radix_t *t, const unsigned index,
+                             const unsigned length)
+{
+    // Labels in the pool are never moved, so suffixes can refer to them.
+    const trie_radix_node_t n = t->nodes[index];
+    const unsigned child = _radix_new_node(t, "", 0, n.value);
+    if (child == EMPTY) {
+        return EMPTY;
+    }
+    trie_radix_node_t *c = &t->nodes[child];
+    c->length = n.length - length;
+    c->index_next = n.index_next;
+    if (c->length > TRIE_RADIX_INLINE) {
+        c->label.offset = n.label.offset + length;
+    } else {
+        memcpy(c->label.chars, &_radix_label(t, &n)[length], c->length);
+    }
+
+    trie_radix_node_t *p = &t->nodes[index];
+    p->length = length;
+    if (n.length > TRIE_RADIX_INLINE && length <= TRIE_RADIX_INLINE) {
+        memcpy(p->label.chars, &t->labels[n.label.offset], length);
+    }
+    p->index_next = child;
+    p->value = NULL;
+    return child;
+}
+
+/*
+Adds new leaf with given label as the last child of node at index.
+*/
+static void *_radix_put_leaf(trie_radix_t *t, const unsigned index,
+                             const char *k, const unsigned length,
+                             const void *v)
+{
+    const unsigned leaf = _radix_new_node(t, k, length, v);
+    if (leaf == EMPTY) {
+        return NULL;
+    }
+    unsigned *link = &t->nodes[index].index_next;
+    while (*link != EMPTY) {
+        link = &t->nodes[*link].index_alt;
+    }
+    *link = leaf;
+    return (void *) v;
+}
+
+void *trie_radix_put(trie_radix_t *t, const char *key, const void *value)
+{
+    if (key[0] == '\0') {
+        return NULL;
+    }
+    const char *k = key;
+    unsigned n = strlen(key);
+    for (unsigned index = 0;;) {
+        const unsigned c = _radix_child(t, index, *k);
+        if (c == EMPTY) {
+            return _radix_put_leaf(t, index, k, n, value);
+        }
+        const trie_radix_node_t *node = &t->nodes[c];
+        const char *label = _radix_label(t, node);
+        unsigned p = 1;
+        while (p < node->length && p < n && label[p] == k[p]) {
+            ++p;
+        }
+        if (p < node->length && _radix_split(t, c, p) == EMPTY) {
+            return NULL;
+        }
+        k += p;
+        n -= p;
+        if (n == 0) {
+            t->nodes[c].value = value;
+            return (void *) value;
+        }
+        index = c;
+    }
+}
+
+void *trie_radix_get(const trie_radix_t *t, const char *key)
+{
+    if (key[0] == '\0') {
+        return NULL;
+    }
+    const char *k = key;
+    size_t n = strlen(key);
+    unsigned index = 0;
+    while (n != 0) {
+        index = _radix_child(t, index, *k);
+        if (index == EMPTY) {
+            return NULL;
+        }
+        const trie_radix_node_t *node = &t->nodes[index];
+        if (node->length > n
+                || memcmp(_radix_label(t, node), k, node->length) != 0) {
+            return NULL;
+        }
+        k += node->length;
+        n -= node->length;
+    }
+    return (void *) t->nodes[index].value;
+}
+
+char *trie_radix_suggest(const trie_radix_t *t, const char *key)
+{
+    _string_t result;
+    if (_string_alloc(&result, 16) == -1) {
+        return NULL;
+    }
+    // Keys are followed as far as they match. Past that, keys are ended if
+    // possible, or else completed by first children if the key is at its end,
+    // or by last children if not, just like trie_suggest() does.
+    const char *k = key;
+    for (unsigned index = 0;;) {
+        const trie_radix_node_t *node = &t->nodes[index];
+        unsigned c = *k != '\0' ? _radix_child(t, index, *k) : EMPTY;
+        if (c == EMPTY && (node->value != NULL || node->index_next == EMPTY)) {
+            break;
+        }
+        if (c == EMPTY) {
+            c = node->index_next;
+            while (*k != '\0' && t->nodes[c].index_alt != EMPTY) {
+                c = t->nodes[c].index_alt;
+            }
+        }
+        const trie_radix_node_t *child = &t->nodes[c];
+        const char *label = _radix_label(t, child);
+        for (unsigned i = 0; i < child->length; ++i) {
+            if (*k == label[i]) {
+                ++k;
+            }
+            if (_string_append(&result, label[i]) == -1) {
+                free(result.origin);
+                return NULL;
+            }
+        }
+        index = c;
+    }
+    if (_string_append(&result, '\0') == -1) {
+        free(result.origin);
+        return NULL;
+    }
+    return result.origin;
+}
+
+/*
+Nodes of shared TRIEs are only added, and are linked into the TRIE only after
+being fully written. When nodes must be moved, they are copied to a new array,
+which is published before the old is freed. Readers are counted by the parity
+of the epoch in which they started, allowing writers to wait for all readers of
+an old array to leave.
+
+Each thread counts itself in one of many reader slots, each on a cache line of
+its own, for readers not to contend with each other. Writers sum all slots.
+*/
+#define _CACHE_LINE 64
+#define _SHARED_SLOTS 64
+
+typedef struct {
+    _Alignas(_CACHE_LINE) unsigned long readers[2];
+} _shared_slot_t;
+
+struct trie_shared {
+    // Read by every reader, and only written when nodes are moved.
+    trie_node_t *nodes;
+    unsigned long epoch;
+
+    _Alignas(_CACHE_LINE) unsigned amount, limit;
+    pthread_mutex_t lock;
+
+    _shared_slot_t slots[_SHARED_SLOTS];
+};
+
+static unsigned _shared_slots_used;
+static _Thread_local unsigned _shared_slot = (unsigned) -1;
+
+/*
+Returns reader slot of calling thread. Threads are given slots in turn.
+*/
+static _shared_slot_t *_shared_slot_of(trie_shared_t *s)
+{
+    if (_shared_slot == (unsigned) -1) {
+        _shared_slot = __atomic_fetch_add(&_shared_slots_used, 1,
+                                          __ATOMIC_RELAXED) % _SHARED_SLOTS;
+    }
+    return &s->slots[_shared_slot];
+}
+
+trie_shared_t *trie_shared_create(const unsigned initial_node_capacity)
+{
+    trie_shared_t *s = aligned_alloc(_CACHE_LINE, sizeof(trie_shared_t));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->limit = initial_node_capacity > 0 ? initial_node_capacity : 1;
+    s->nodes = malloc(s->limit * sizeof(trie_node_t));
+    if (s->nodes == NULL || pthread_mutex_init(&s->lock, NULL) != 0) {
+        free(s->nodes);
+        free(s);
+        return NULL;
+    }
+    s->nodes[0] = (trie_node_t) {'a', EMPTY, {EMPTY}};
+    s->amount = 1;
+    s->epoch = 0;
+    memset(s->slots, 0, sizeof(s->slots));
+    return s;
+}
+
+void trie_shared_destroy(trie_shared_t *s)
+{
+    pthread_mutex_destroy(&s->lock);
+    free(s->nodes);
+    free(s);
+}
+
+/*
+Waits for all readers that started before the call to leave. Readers of both
+parities have to be waited for, as readers of the current parity may have
+started before the epoch last changed.
+*/
+static void _shared_wait(trie_shared_t *s)
+{
+    for (int i = 0; i < 2; ++i) {
+        const unsigned long e = __atomic_fetch_add(&s->epoch, 1,
+                                __ATOMIC_SEQ_CST);
+        for (unsigned j = 0; j < _SHARED_SLOTS; ++j) {
+            const unsigned long *r = &s->slots[j].readers[e & 1];
+            while (__atomic_load_n(r, __ATOMIC_SEQ_CST) != 0) {
+                sched_yield();
+            }
+        }
+    }
+}
+
+void trie_shared_synchronize(trie_shared_t *s)
+{
+    pthread_mutex_lock(&s->lock);
+    _shared_wait(s);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static unsigned _shared_new_node(trie_shared_t *s, const int c)
+{
+    if (s->amount == s->limit) {
+        trie_node_t *nodes = malloc(s->limit * 2 * sizeof(trie_node_t));
+        if (nodes == NULL) {
+            return EMPTY;
+        }
+        memcpy(nodes, s->nodes, s->amount * sizeof(trie_node_t));
+        trie_node_t *old = s->nodes;
+        __atomic_store_n(&s->nodes, nodes, __ATOMIC_SEQ_CST);
+        s->limit *= 2;
+        _shared_wait(s);
+        free(old);
+    }
+    _node_init(&s->nodes[s->amount], c);
+    return s->amount++;
+}
+
+static void *_shared_put(trie_shared_t *s, const char *k, const void *v)
+{
+    for (unsigned index = 0;;) {
+        const trie_node_t *n = &s->nodes[index];
+        const int c = _string_char(k);
+        const int match = n->character == c;
+        if (match && c == END) {
+            __atomic_store_n(&s->nodes[index].value, v, __ATOMIC_RELEASE);
+            return (void *) v;
+        }
+        unsigned next = match ? n->index_next : n->index_alt;
+        if (next == EMPTY) {
+            next = _shared_new_node(s, match ? _string_char(&k[1]) : c);
+            if (next == EMPTY) {
+                return NULL;
+            }
+            // The nodes may have been moved when the new one was added.
+            trie_node_t *m = &s->nodes[index];
+            __atomic_store_n(match ? &m->index_next : &m->index_alt, next,
+                             __ATOMIC_RELEASE);
+        }
+        k += match;
+        index = next;
+    }
+}
+
+void *trie_shared_put(trie_shared_t *s, const char *key, const void *value)
+{
+    if (key[0] == '\0') {
+        return NULL;
+    }
+    pthread_mutex_lock(&s->lock);
+    void *result = _shared_put(s, key, value);
+    pthread_mutex_unlock(&s->lock);
+    return result;
+}
+
+void *trie_shared_get(trie_shared_t *s, const char *key)
+{
+    if (key[0] == '\0') {
+        return NULL;
+    }
+    // The epoch is checked again after counting the reader, in case a writer
+    // started waiting for readers of the previous epoch meanwhile.
+    unsigned long *readers = _shared_slot_of(s)->readers;
+    unsigned long e;
+    for (;;) {
+        e = __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&readers[e & 1], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST) == e) {
+            break;
+        }
+        __atomic_fetch_sub(&readers[e & 1], 1, __ATOMIC_SEQ_CST);
+    }
+
+    const trie_node_t *nodes = __atomic_load_n(&s->nodes, __ATOMIC_ACQUIRE);
+    const void *value = NULL;
+    for (unsigned index = 0;;) {
+        const trie_node_t *n = &nodes[index];
+        const int c = _string_char(key);
+        if (n->character == c && c == END) {
+            value = __atomic_load_n(&n->value, __ATOMIC_ACQUIRE);
+            break;
+        }
+        if (n->character == c) {
+            index = __atomic_load_n(&n->index_next, __ATOMIC_ACQUIRE);
+            ++key;
+        } else {
+            index = __atomic_load_n(&n->index_alt, __ATOMIC_ACQUIRE);
+        }
+        if (index == EMPTY) {
+            break;
+        }
+    }
+    __atomic_fetch_sub(&readers[e & 1], 1, __ATOMIC_RELEASE);
+    return (void *) value;
+}
@@ -9,16 +9,19 @@ void pointer values related to given key strings.
 #ifndef TRIE_H
 #define TRIE_H
 
+#include <stddef.h>
+
 /*!
 Represents a character and a void pointer value within a TRIE.
+
+Characters are key bytes as unsigned characters, or -1 at the end of a key.
 */
 typedef struct {
     int character;
+    unsigned index_alt;
     union {
-        struct {
-            unsigned index_next, index_alt;
-        };
-        const void *value; // Is only available if character is '\0'.
+        unsigned index_next;
+        const void *value; // Is only available if character is -1.
     };
 } trie_node_t;
 
@@ -28,6 +31,10 @@ Represents all nodes of a TRIE, and the memory which house them.
 typedef struct {
     trie_node_t *nodes;
     unsigned amount, limit;
+    unsigned free; // First of removed nodes to reuse, or 0 if none.
+
+    const char *blob; // Only set if values are offsets into a value blob.
+    size_t mapped; // Only non-zero if opened using trie_open_mmap().
 } trie_t;
 
 /*!
@@ -41,15 +48,35 @@ Frees all memory kept by TRIE.
 */
 void trie_destroy(trie_t *t);
 
+/*!
+Creates and returns new TRIE holding n keys and their values, where keys must
+be sorted in order of their bytes as unsigned characters, as by strcmp(). If a
+key occurs more than once, its last value is used.
+
+All nodes are allocated at once, and the children of each node are placed next
+to each other. NULL is returned in case of memory allocation failure, or if
+the keys are not sorted or any key is empty.
+*/
+trie_t *trie_build_sorted(const char *const *keys, const void *const *values,
+                          size_t n);
+
 /*!
 Inserts given key/value pair to TRIE, replacing any previous value associated
 with the same key.
 
 Returns inserted value. NULL is returned in case of memory allocation failure,
-or if attempting to put a value with an empty key.
+if attempting to put a value with an empty key, or if the TRIE was opened using
+trie_open_mmap().
 */
 void *trie_put(trie_t *t, const char *key, const void *value);
 
+/*!
+Inserts value under the len bytes at key, which may hold any bytes, including
+zeros. Otherwise behaves as trie_put().
+*/
+void *trie_put_bytes(trie_t *t, const void *key, size_t len,
+                     const void *value);
+
 /*!
 Finds value associated with given key in TRIE.
 
@@ -57,6 +84,46 @@ Returns found value, or NULL in case no associated value could be found.
 */
 void *trie_get(const trie_t *t, const char *key);
 
+/*!
+Finds value associated with the len bytes at key, which need not be followed
+by a '\0'. Returns found value, or NULL in case no associated value could be
+found.
+*/
+void *trie_get_bytes(const trie_t *t, const void *key, size_t len);
+
+/*!
+Finds values associated with n keys in TRIE, and writes them to out, which
+must have room for n values. NULL is written for keys without values.
+
+Many lookups are advanced in turn, while the nodes they need next are fetched
+from memory, which makes batches faster than as many calls to trie_get() for
+TRIEs much larger than the CPU caches.
+*/
+void trie_get_batch(const trie_t *t, const char *const *keys, size_t n,
+                    const void **out);
+
+/*!
+Removes key and its value from TRIE. Nodes no longer part of any key are kept
+for reuse by later insertions.
+
+Returns the value removed, or NULL if the key was not found or if the TRIE was
+opened using trie_open_mmap().
+*/
+void *trie_remove(trie_t *t, const char *key);
+
+/*!
+Removes the len bytes at key from TRIE. Otherwise behaves as trie_remove().
+*/
+void *trie_remove_bytes(trie_t *t, const void *key, size_t len);
+
+/*!
+Moves all nodes still part of any key to a new array, in which the children of
+each node are next to each other, and frees the memory of the old one. Indices
+of nodes are changed. Returns 0, or -1 in case of memory allocation failure or
+if the TRIE was opened using trie_open_mmap().
+*/
+int trie_compact(trie_t *t);
+
 /*!
 Suggests an existing key using the given key. NULL is returned in case of memory
 allocation failure.
@@ -65,10 +132,288 @@ The string returned has to be destroyed using free() once no longer needed.
 */
 char *trie_suggest(const trie_t *t, const char *key);
 
+/*!
+Suggests an existing key using the len bytes at key. The length of the key
+suggested is written to size, unless size is NULL, and the key is followed by
+a '\0'. NULL is returned in case of memory allocation failure.
+
+The key returned has to be destroyed using free() once no longer needed.
+*/
+void *trie_suggest_bytes(const trie_t *t, const void *key, size_t len,
+                         size_t *size);
+
 /*!
 Copies all TRIE data from t into target, and returns target. NULL is returned in
-case of memory allocation failure.
+case of memory allocation failure, or if target was opened using
+trie_open_mmap().
+
+Values of a TRIE opened with a value blob are copied as pointers into its
+blob, which remain valid only until that TRIE is destroyed.
  */
 trie_t *trie_copy(const trie_t *t, trie_t *target);
 
+/*!
+Writes TRIE to a file at path, as an image which can be opened using
+trie_open_mmap(). Returns 0 on success.
+
+Values are written as integers. If blob is NULL, each value pointer is written
+as is, which is useful if values are integer payloads cast to pointers.
+Otherwise, all values must point into the blob_size bytes at blob, which are
+written to the image. -1 is returned if a value is outside the blob, or if the
+file could not be written.
+*/
+int trie_save(const trie_t *t, const char *path, const void *blob,
+              size_t blob_size);
+
+/*!
+Maps TRIE image written by trie_save() into memory, and returns a read-only
+TRIE using the mapped nodes. Pages of the image are read from the file as they
+are accessed, and may be shared by processes mapping the same file. The TRIE
+must be destroyed using trie_destroy().
+
+If blob is not NULL, it is set to point to the mapped value blob, and its size
+is written to blob_size. Values returned by trie_get() point into the mapped
+blob if one was saved, or are the integers written otherwise.
+
+NULL is returned if the file could not be mapped, if it was not written by a
+compatible build of TRIE, or in case of memory allocation failure.
+*/
+trie_t *trie_open_mmap(const char *path, const void **blob, size_t *blob_size);
+
+/*!
+Represents a position among the keys of a TRIE starting with some prefix,
+which are enumerated in order of their bytes as unsigned characters.
+
+The key at the position is kept in a buffer provided by the caller, followed by
+a '\0'. As keys put using trie_put_bytes() may contain zeros, the length of the
+key is kept as well.
+*/
+typedef struct {
+    const trie_t *trie;
+    char *key;
+    size_t size; // Size of key buffer.
+    size_t prefix; // Length of prefix.
+    size_t length; // Length of key.
+    unsigned head; // First node of children of prefix, if in the TRIE.
+    int state; // Zero before first key, one after, and -1 when done.
+} trie_cursor_t;
+
+/*!
+Initializes cursor positioned before the first key of TRIE starting with given
+prefix. Keys are written to buffer, which must be at least size bytes large.
+Returns 0, or -1 if the prefix does not fit in the buffer.
+
+The TRIE must not be changed while the cursor is used.
+*/
+int trie_cursor_init(trie_cursor_t *c, const trie_t *t, const char *prefix,
+                     char *buffer, size_t size);
+
+/*!
+Moves cursor to given key, which need not exist, so that the following call of
+trie_cursor_next() yields the first key after it. Useful for resuming after the
+last key of a previous cursor. Returns 0, or -1 if the key does not fit in the
+buffer of the cursor.
+*/
+int trie_cursor_seek(trie_cursor_t *c, const char *key);
+
+/*!
+Moves cursor to the next key, which is written to the cursor buffer, and sets
+value to its value. Returns 1 if a key was found, or 0 if there are no more
+keys.
+
+If the next key does not fit in the buffer, -1 is returned and the cursor is
+not moved. A larger buffer, holding a copy of the current key, may then be
+given to the cursor before trying again.
+*/
+int trie_cursor_next(trie_cursor_t *c, const void **value);
+
+/*!
+Represents a node of a packed TRIE.
+*/
+typedef struct {
+    unsigned child; // Index of first child node.
+    unsigned labels; // Offset of child count, followed by child labels.
+    const void *value;
+} trie_packed_node_t;
+
+/*!
+Represents a read-only TRIE, in which the children of each node are kept next
+to each other.
+
+Nodes are stored in breadth-first order. Nodes with at most TRIE_PACKED_SPARSE
+children have their child labels stored as a sorted array, which is searched
+using SIMD byte comparisons where available. Nodes with more children have a
+table of 256 bytes, mapping every label to its child.
+*/
+typedef struct {
+    trie_packed_node_t *nodes;
+    unsigned char *labels;
+    unsigned amount;
+} trie_packed_t;
+
+#define TRIE_PACKED_SPARSE 32
+
+/*!
+Creates packed copy of TRIE. The TRIE is not modified, and later changes to it
+are not reflected by the copy. Keys containing zero bytes are left out, as they
+cannot be looked up. NULL is returned in case of memory allocation failure.
+*/
+trie_packed_t *trie_pack(const trie_t *t);
+
+/*!
+Frees all memory kept by packed TRIE.
+*/
+void trie_packed_destroy(trie_packed_t *p);
+
+/*!
+Finds value associated with given key in packed TRIE.
+
+Returns found value, or NULL in case no associated value could be found.
+*/
+void *trie_packed_get(const trie_packed_t *p, const char *key);
+
+/*!
+Represents a read-only TRIE stored as a double-array.
+
+The node reached from node s by byte c is found at base[s] + c, and exists if
+its check equals s. The key ending at node s exists if the check of base[s]
+equals s, in which case the base of that terminal slot indexes its value.
+*/
+typedef struct {
+    int *base, *check;
+    const void **values;
+    unsigned size;
+} trie_frozen_t;
+
+/*!
+Compiles TRIE into a frozen TRIE, which is not affected by later changes to
+the TRIE. Keys containing zero bytes are left out, as they cannot be looked up.
+NULL is returned in case of memory allocation failure.
+*/
+trie_frozen_t *trie_freeze(const trie_t *t);
+
+/*!
+Frees all memory kept by frozen TRIE.
+*/
+void trie_frozen_destroy(trie_frozen_t *f);
+
+/*!
+Finds value associated with given key in frozen TRIE.
+
+Returns found value, or NULL in case no associated value could be found.
+*/
+void *trie_frozen_get(const trie_frozen_t *f, const char *key);
+
+/*!
+Suggests an existing key of frozen TRIE using the given key, preferring keys
+with the smallest characters where there is a choice. NULL is returned in case
+of memory allocation failure.
+
+The string returned has to be destroyed using free() once no longer needed.
+*/
+char *trie_frozen_suggest(const trie_frozen_t *f, const char *key);
+
+/*!
+Maximum length of labels kept within radix TRIE nodes.
+*/
+#define TRIE_RADIX_INLINE 8
+
+/*!
+Represents a key fragment and a void pointer value within a radix TRIE. Nodes
+without keys ending at them have NULL values.
+*/
+typedef struct {
+    unsigned index_next, index_alt;
+    unsigned length; // Labels longer than TRIE_RADIX_INLINE are in the pool.
+    union {
+        char chars[TRIE_RADIX_INLINE];
+        unsigned offset;
+    } label;
+    const void *value;
+} trie_radix_node_t;
+
+/*!
+Represents a radix TRIE, in which chains of nodes with single children are
+collapsed into one node labeled with all their characters.
+*/
+typedef struct {
+    trie_radix_node_t *nodes;
+    unsigned amount, limit;
+
+    char *labels; // Pool of long labels.
+    unsigned labels_size, labels_limit;
+} trie_radix_t;
+
+/*!
+Creates and returns new radix TRIE object with given initial node capacity.
+NULL is returned in case of memory allocation failure.
+*/
+trie_radix_t *trie_radix_create(const unsigned initial_node_capacity);
+
+/*!
+Frees all memory kept by radix TRIE.
+*/
+void trie_radix_destroy(trie_radix_t *t);
+
+/*!
+Inserts given key/value pair to radix TRIE, just like trie_put().
+*/
+void *trie_radix_put(trie_radix_t *t, const char *key, const void *value);
+
+/*!
+Finds value associated with given key in radix TRIE, just like trie_get().
+*/
+void *trie_radix_get(const trie_radix_t *t, const char *key);
+
+/*!
+Suggests an existing key of radix TRIE using the given key, just like
+trie_suggest().
+*/
+char *trie_radix_suggest(const trie_radix_t *t, const char *key);
+
+/*!
+Represents a TRIE which may be read by many threads while being written to.
+*/
+typedef struct trie_shared trie_shared_t;
+
+/*!
+Creates and returns new shared TRIE object with given initial node capacity.
+NULL is returned in case of memory allocation failure.
+*/
+trie_shared_t *trie_shared_create(const unsigned initial_node_capacity);
+
+/*!
+Frees all memory kept by shared TRIE. No thread may use the TRIE while or after
+it is destroyed.
+*/
+void trie_shared_destroy(trie_shared_t *s);
+
+/*!
+Inserts given key/value pair to shared TRIE, just like trie_put(). Writers are
+serialized, and never wait for readers except when the nodes of the TRIE have
+to be moved to make room for more.
+
+Such a writer waits, while holding the lock serializing writers, until every
+reader of the old nodes has returned. A reader that is preempted in the middle
+of a lookup therefore delays all writers until it is run again.
+
+A replaced value may still be returned to readers that started before it was
+replaced. Call trie_shared_synchronize() before destroying it.
+*/
+void *trie_shared_put(trie_shared_t *s, const char *key, const void *value);
+
+/*!
+Finds value associated with given key in shared TRIE, just like trie_get().
+Never blocks, and may be called by any number of threads at once. Threads are
+counted in per-thread slots on cache lines of their own, for lookups not to
+contend with each other.
+*/
+void *trie_shared_get(trie_shared_t *s, const char *key);
+
+/*!
+Waits until all calls of trie_shared_get() that were in progress when this
+function was called have returned.
+*/
+void trie_shared_synchronize(trie_shared_t *s);
+
 #endif
@@ -1,4 +1,7 @@
 #include "trie.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <../unit/unit.h>
 
@@ -10,6 +13,18 @@ void test_put_beyond_capacity(T_t *T, void *t);
 void test_put_get(T_t *T, void *t);
 void test_put_suggest(T_t *T, void *t);
 void test_copy(T_t *T, void *t);
+void test_put_get_prefixes(T_t *T, void *t);
+void test_pack(T_t *T, void *t);
+void test_freeze(T_t *T, void *t);
+void test_save_open_mmap(T_t *T, void *t);
+void test_radix(T_t *T, void *t);
+void test_shared(T_t *T, void *_);
+void test_cursor(T_t *T, void *t);
+void test_build_sorted(T_t *T, void *_);
+void test_put_get_bytes(T_t *T, void *t);
+void test_get_batch(T_t *T, void *t);
+void test_remove(T_t *T, void *t);
+void test_compact(T_t *T, void *t);
 
 void provider_trie(T_t *T, unit_test_t test);
 
@@ -20,6 +35,18 @@ void suite_trie(T_t *T)
     unit_run_test(T, &test_put_get, &provider_trie);
     unit_run_test(T, &test_put_suggest, &provider_trie);
     unit_run_test(T, &test_copy, &provider_trie);
+    unit_run_test(T, &test_put_get_prefixes, &provider_trie);
+    unit_run_test(T, &test_pack, &provider_trie);
+    unit_run_test(T, &test_freeze, &provider_trie);
+    unit_run_test(T, &test_save_open_mmap, &provider_trie);
+    unit_run_test(T, &test_radix, &provider_trie);
+    unit_run_test(T, &test_shared, NULL);
+    unit_run_test(T, &test_cursor, &provider_trie);
+    unit_run_test(T, &test_build_sorted, NULL);
+    unit_run_test(T, &test_put_get_bytes, &provider_trie);
+    unit_run_test(T, &test_get_batch, &provider_trie);
+    unit_run_test(T, &test_remove, &provider_trie);
+    unit_run_test(T, &test_compact, &provider_trie);
 }
 
 int main()
@@ -111,6 +138,583 @@ void test_copy(T_t *T, void *t)
     trie_destroy(t1);
 }
 
+void test_put_get_prefixes(T_t *T, void *t)
+{
+    const char *keys[] = {"abc", "ab", "abcd", "a", "b", "abd", "abcde"};
+    const unsigned n = sizeof(keys) / sizeof(keys[0]);
+
+    for (unsigned i = 0; i < n; ++i) {
+        unit_assert(T, trie_put(t, keys[i], keys[i]) == keys[i]);
+        for (unsigned j = 0; j <= i; ++j) {
+            if (trie_get(t, keys[j]) != keys[j]) {
+                unit_failf(T, "%s lost after putting %s", keys[j], keys[i]);
+            }
+        }
+    }
+    unit_assert(T, trie_get(t, "abcdef") == NULL);
+    unit_assert(T, trie_get(t, "c") == NULL);
+    assert_trie_suggest(T, t, "", "a");
+    assert_trie_suggest(T, t, "ab", "ab");
+    assert_trie_suggest(T, t, "abcdx", "abcd");
+}
+
+/*
+Writes key number i, of keys with many different first characters, to key.
+*/
+void make_key(char key[16], unsigned i)
+{
+    unsigned x = i * 2654435761u;
+    key[0] = '!' + i % 90;
+    unsigned length = 1 + (x >> 8) % 10;
+    for (unsigned j = 1; j < length; ++j) {
+        key[j] = 'a' + (x >> (j * 3) & 0xf);
+    }
+    key[length] = '\0';
+}
+
+void test_pack(T_t *T, void *t)
+{
+    static char keys[1000][16];
+    for (unsigned i = 0; i < 1000; ++i) {
+        make_key(keys[i], i);
+        if (trie_put(t, keys[i], keys[i]) != keys[i]) {
+            unit_fatal(T, "trie_put() == NULL");
+        }
+    }
+    trie_packed_t *p = trie_pack(t);
+    if (p == NULL) {
+        unit_fatal(T, "trie_pack() == NULL");
+    }
+    unit_assert(T, p->amount <= ((trie_t *) t)->amount + 1);
+    for (unsigned i = 0; i < 1000; ++i) {
+        if (trie_packed_get(p, keys[i]) != trie_get(t, keys[i])) {
+            unit_failf(T, "trie_packed_get(p, \"%s\") != trie_get()", keys[i]);
+        }
+    }
+    unit_assert(T, trie_packed_get(p, "") == NULL);
+    unit_assert(T, trie_packed_get(p, "!zzzzzzzz") == NULL);
+    unit_assert(T, trie_packed_get(p, "\x7f") == NULL);
+    trie_packed_destroy(p);
+}
+
+void assert_frozen_suggest(T_t *T, trie_frozen_t *f, const char *in,
+                           const char *result)
+{
+    char *actual_result = trie_frozen_suggest(f, in);
+    unit_assert(T, actual_result != NULL);
+    if (strcmp(result, actual_result) != 0) {
+        unit_failf(T, "\"%s\" != \"%s\"", result, actual_result);
+    }
+    free(actual_result);
+}
+
+void test_freeze(T_t *T, void *t)
+{
+    trie_frozen_t *f = trie_freeze(t);
+    if (f == NULL) {
+        unit_fatal(T, "trie_freeze() == NULL");
+    }
+    unit_assert(T, trie_frozen_get(f, "a") == NULL);
+    assert_frozen_suggest(T, f, "abc", "");
+    trie_frozen_destroy(f);
+
+    const char *words[] = {"cat", "dog", "donkey", "doodle", "do"};
+    for (unsigned i = 0; i < sizeof(words) / sizeof(words[0]); ++i) {
+        trie_put(t, words[i], words[i]);
+    }
+    f = trie_freeze(t);
+    if (f == NULL) {
+        unit_fatal(T, "trie_freeze() == NULL");
+    }
+    unit_assert(T, trie_frozen_get(f, "do") == words[4]);
+    unit_assert(T, trie_frozen_get(f, "dod") == NULL);
+    unit_assert(T, trie_frozen_get(f, "doodles") == NULL);
+    assert_frozen_suggest(T, f, "caturday", "cat");
+    assert_frozen_suggest(T, f, "d", "do");
+    assert_frozen_suggest(T, f, "don", "donkey");
+    assert_frozen_suggest(T, f, "doogle", "doodle");
+    trie_frozen_destroy(f);
+
+    static char keys[1000][16];
+    for (unsigned i = 0; i < 1000; ++i) {
+        make_key(keys[i], i);
+        trie_put(t, keys[i], keys[i]);
+    }
+    f = trie_freeze(t);
+    if (f == NULL) {
+        unit_fatal(T, "trie_freeze() == NULL");
+    }
+    for (unsigned i = 0; i < 1000; ++i) {
+        if (trie_frozen_get(f, keys[i]) != trie_get(t, keys[i])) {
+            unit_failf(T, "trie_frozen_get(f, \"%s\") != trie_get()", keys[i]);
+        }
+    }
+    unit_assert(T, trie_frozen_get(f, "\xff") == NULL);
+    trie_frozen_destroy(f);
+}
+
+void test_save_open_mmap(T_t *T, void *t)
+{
+    const char blob[] = "cat\0dog\0donkey\0doodle";
+    const char *path = "trie.unit.img";
+    const char *keys[] = {"cat", "dog", "donkey", "doodle", "do"};
+    const unsigned offsets[] = {0, 4, 8, 15, 4};
+    for (unsigned i = 0; i < 5; ++i) {
+        trie_put(t, keys[i], &blob[offsets[i]]);
+    }
+    if (trie_save(t, path, blob, sizeof(blob)) == -1) {
+        unit_fatal(T, "trie_save() == -1");
+    }
+
+    const void *b = NULL;
+    size_t size = 0;
+    trie_t *m = trie_open_mmap(path, &b, &size);
+    if (m == NULL) {
+        remove(path);
+        unit_fatal(T, "trie_open_mmap() == NULL");
+    }
+    unit_assert(T, size == sizeof(blob));
+    for (unsigned i = 0; i < 5; ++i) {
+        const char *v = trie_get(m, keys[i]);
+        if (v != &((const char *) b)[offsets[i]]) {
+            unit_failf(T, "trie_get(m, \"%s\") not in blob", keys[i]);
+        }
+    }
+    unit_assert(T, trie_get(m, "d") == NULL);
+    assert_trie_suggest(T, m, "doogle", "doodle");
+    unit_assert(T, trie_put(m, "cow", blob) == NULL);
+
+    // Copies resolve values into the mapped blob, and can then be changed.
+    trie_t *c = trie_create(2);
+    unit_assert(T, c != NULL && trie_copy(m, c) == c);
+    const int z = 7;
+    unit_assert(T, trie_put(c, "z", &z) == &z);
+    unit_assert(T, trie_get(c, "z") == &z);
+    unit_assert(T, trie_get(c, "dog") == trie_get(m, "dog"));
+    trie_destroy(c);
+
+    // Packing resolves values into the mapped blob.
+    trie_frozen_t *f = trie_freeze(m);
+    unit_assert(T, f != NULL && trie_frozen_get(f, "dog") == trie_get(m, "dog"));
+    trie_frozen_destroy(f);
+    trie_destroy(m);
+
+    // Values outside the blob cannot be saved.
+    trie_put(t, "cow", "moo");
+    unit_assert(T, trie_save(t, path, blob, sizeof(blob)) == -1);
+
+    // Without a blob, values are saved as integers.
+    trie_put(t, "cow", (void *) (uintptr_t) 42);
+    unit_assert(T, trie_save(t, path, NULL, 0) == 0);
+    m = trie_open_mmap(path, &b, &size);
+    remove(path);
+    if (m == NULL) {
+        unit_fatal(T, "trie_open_mmap() == NULL");
+    }
+    unit_assert(T, b == NULL && size == 0);
+    unit_assert(T, trie_get(m, "cow") == (void *) (uintptr_t) 42);
+    trie_destroy(m);
+
+    unit_assert(T, trie_open_mmap(path, NULL, NULL) == NULL);
+}
+
+void test_radix(T_t *T, void *t)
+{
+    trie_radix_t *r = trie_radix_create(2);
+    if (r == NULL) {
+        unit_fatal(T, "trie_radix_create() == NULL");
+    }
+    const char *urls[] = {
+        "https://example.com/a/very/long/path",
+        "https://example.com/a/very/long/pathway",
+        "https://example.com/a/v",
+        "https://example.org/",
+        "http",
+        "cat", "dog", "donkey", "doodle", "do",
+    };
+    const unsigned n = sizeof(urls) / sizeof(urls[0]);
+    for (unsigned i = 0; i < n; ++i) {
+        unit_assert(T, trie_radix_put(r, urls[i], urls[i]) == urls[i]);
+        trie_put(t, urls[i], urls[i]);
+    }
+    static char keys[1000][16];
+    for (unsigned i = 0; i < 1000; ++i) {
+        make_key(keys[i], i);
+        trie_radix_put(r, keys[i], keys[i]);
+        trie_put(t, keys[i], keys[i]);
+    }
+    unit_assert(T, r->amount < ((trie_t *) t)->amount / 2);
+
+    for (unsigned i = 0; i < n; ++i) {
+        unit_assert(T, trie_radix_get(r, urls[i]) == urls[i]);
+    }
+    for (unsigned i = 0; i < 1000; ++i) {
+        if (trie_radix_get(r, keys[i]) != trie_get(t, keys[i])) {
+            unit_failf(T, "trie_radix_get(r, \"%s\") != trie_get()", keys[i]);
+        }
+    }
+    unit_assert(T, trie_radix_get(r, "https://example.com/a/very") == NULL);
+    unit_assert(T, trie_radix_get(r, "https://example.com/a/vx") == NULL);
+    unit_assert(T, trie_radix_get(r, "") == NULL);
+
+    // Suggestions are the same as those of an equally built TRIE, except at
+    // the root, where the first node of the TRIE is always its first child.
+    const char *probes[] = {
+        "d", "doogle", "caturday", "https://example.com/b", "htt", "~",
+        "https://example.com/a/very/long/pa", "!", "Sa", "zz",
+    };
+    for (unsigned i = 0; i < sizeof(probes) / sizeof(probes[0]); ++i) {
+        char *expected = trie_suggest(t, probes[i]);
+        char *actual = trie_radix_suggest(r, probes[i]);
+        if (expected == NULL || actual == NULL) {
+            unit_fatal(T, "trie_suggest() == NULL");
+        }
+        if (strcmp(expected, actual) != 0) {
+            unit_failf(T, "\"%s\" != \"%s\"", expected, actual);
+        }
+        free(expected);
+        free(actual);
+    }
+    trie_radix_destroy(r);
+}
+
+void test_cursor(T_t *T, void *t)
+{
+    static char keys[1000][16];
+    unsigned expected = 0;
+    for (unsigned i = 0; i < 1000; ++i) {
+        make_key(keys[i], i);
+        trie_put(t, keys[i], keys[i]);
+    }
+    for (unsigned i = 0; i < 1000; ++i) {
+        expected += keys[i][0] == 'b' && trie_get(t, keys[i]) == keys[i];
+    }
+    trie_put(t, "b\xe9", "high");
+
+    char buffer[16], last[16] = "", page[16] = "";
+    const void *value;
+    trie_cursor_t c;
+    unit_assert(T, trie_cursor_init(&c, t, "b", buffer, sizeof(buffer)) == 0);
+    unsigned found = 0;
+    while (trie_cursor_next(&c, &value) == 1) {
+        if (strcmp(last, buffer) >= 0) {
+            unit_failf(T, "\"%s\" not after \"%s\"", buffer, last);
+        }
+        if (trie_get(t, buffer) != value || buffer[0] != 'b') {
+            unit_failf(T, "trie_get(t, \"%s\") != value", buffer);
+        }
+        if (++found == 10) {
+            strcpy(page, buffer);
+        }
+        strcpy(last, buffer);
+    }
+    unit_assert(T, found == expected + 1);
+    unit_assert(T, strcmp(last, "b\xe9") == 0);
+    unit_assert(T, trie_cursor_next(&c, &value) == 0);
+
+    // Resuming after the tenth key yields the remaining keys.
+    unit_assert(T, trie_cursor_init(&c, t, "b", buffer, sizeof(buffer)) == 0);
+    unit_assert(T, trie_cursor_seek(&c, page) == 0);
+    unsigned rest = 0;
+    while (trie_cursor_next(&c, &value) == 1) {
+        ++rest;
+    }
+    unit_assert(T, rest == found - 10);
+
+    // Keys that do not fit leave the cursor where it was.
+    char small[2];
+    unit_assert(T, trie_cursor_init(&c, t, "b", small, sizeof(small)) == 0);
+    unit_assert(T, trie_cursor_seek(&c, "b") == 0);
+    unit_assert(T, trie_cursor_next(&c, &value) == -1);
+    unit_assert(T, strcmp(small, "b") == 0);
+
+    unit_assert(T, trie_cursor_init(&c, t, "b\x01", buffer, 16) == 0);
+    unit_assert(T, trie_cursor_next(&c, &value) == 0);
+    unit_assert(T, trie_cursor_init(&c, t, "", buffer, 16) == 0);
+    unit_assert(T, trie_cursor_seek(&c, "a") == 0);
+    unit_assert(T, trie_cursor_next(&c, &value) == 1);
+    unit_assert(T, strcmp(buffer, "a") > 0);
+    unit_assert(T, trie_cursor_seek(&c, "~") == 0);
+    unit_assert(T, trie_cursor_next(&c, &value) == 0);
+}
+
+int compare_keys(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *) a, *(const char *const *) b);
+}
+
+void test_build_sorted(T_t *T, void *_)
+{
+    (void) _;
+
+    static char keys[1000][16];
+    const char *sorted[1000];
+    for (unsigned i = 0; i < 1000; ++i) {
+        make_key(keys[i], i);
+        sorted[i] = keys[i];
+    }
+    qsort(sorted, 1000, sizeof(sorted[0]), compare_keys);
+
+    // Equal keys are put in order, for the last value to be kept.
+    trie_t *expected = trie_create(2);
+    if (expected == NULL) {
+        unit_fatal(T, "trie_create() == NULL");
+    }
+    for (unsigned i = 0; i < 1000; ++i) {
+        trie_put(expected, sorted[i], sorted[i]);
+    }
+    trie_t *t = trie_build_sorted(sorted, (const void *const *) sorted, 1000);
+    if (t == NULL) {
+        trie_destroy(expected);
+        unit_fatal(T, "trie_build_sorted() == NULL");
+    }
+    assert_trie_integrity(T, t);
+    unit_assert(T, t->amount == t->limit);
+    unit_assert(T, t->amount <= expected->amount);
+    for (unsigned i = 0; i < 1000; ++i) {
+        if (trie_get(t, sorted[i]) != trie_get(expected, sorted[i])) {
+            unit_failf(T, "trie_get(t, \"%s\") != trie_get()", sorted[i]);
+        }
+    }
+    for (unsigned i = 0; i < t->amount; ++i) {
+        const unsigned alt = t->nodes[i].index_alt;
+        if (alt != 0 && alt != i + 1) {
+            unit_failf(T, "%u: index_alt %u not adjacent", i, alt);
+        }
+    }
+    unit_assert(T, trie_put(t, "hello", "world") != NULL);
+    unit_assert(T, strcmp(trie_get(t, "hello"), "world") == 0);
+    trie_destroy(t);
+    trie_destroy(expected);
+
+    const char *unsorted[] = {"b", "a"};
+    unit_assert(T, trie_build_sorted(unsorted, NULL, 2) == NULL);
+    const char *empty[] = {"", "a"};
+    unit_assert(T, trie_build_sorted(empty, NULL, 2) == NULL);
+}
+
+#define SHARED_KEYS 5000
+#define SHARED_READERS 4
+
+typedef struct {
+    trie_shared_t *s;
+    char (*keys)[16];
+    unsigned published, done, errors;
+} shared_test_t;
+
+void *shared_reader(void *arg)
+{
+    shared_test_t *x = arg;
+    while (!__atomic_load_n(&x->done, __ATOMIC_ACQUIRE)) {
+        const unsigned n = __atomic_load_n(&x->published, __ATOMIC_ACQUIRE);
+        for (unsigned i = 0; i < n; i += 7) {
+            if (trie_shared_get(x->s, x->keys[i]) != x->keys[i]) {
+                __atomic_fetch_add(&x->errors, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    return NULL;
+}
+
+void test_shared(T_t *T, void *_)
+{
+    (void) _;
+
+    static char keys[SHARED_KEYS][16];
+    shared_test_t x = {trie_shared_create(2), keys, 0, 0, 0};
+    if (x.s == NULL) {
+        unit_fatal(T, "trie_shared_create() == NULL");
+    }
+    for (unsigned i = 0; i < SHARED_KEYS; ++i) {
+        snprintf(keys[i], sizeof(keys[i]), "k%08x", i * 2654435761u);
+    }
+    pthread_t threads[SHARED_READERS];
+    for (unsigned i = 0; i < SHARED_READERS; ++i) {
+        pthread_create(&threads[i], NULL, shared_reader, &x);
+    }
+    // Keys are all distinct, so none of them is ever replaced.
+    for (unsigned i = 0; i < SHARED_KEYS; ++i) {
+        if (trie_shared_put(x.s, keys[i], keys[i]) != keys[i]) {
+            unit_failf(T, "trie_shared_put() == NULL (i: %u)", i);
+            break;
+        }
+        __atomic_store_n(&x.published, i + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&x.done, 1, __ATOMIC_RELEASE);
+    for (unsigned i = 0; i < SHARED_READERS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    unit_assert(T, x.errors == 0);
+    unit_assert(T, trie_shared_get(x.s, "\x7f") == NULL);
+
+    const char *value = "value";
+    unit_assert(T, trie_shared_put(x.s, keys[0], value) == value);
+    trie_shared_synchronize(x.s);
+    unit_assert(T, trie_shared_get(x.s, keys[0]) == value);
+
+    // Characters above 127 are stored as unsigned bytes, as in other TRIEs.
+    unit_assert(T, trie_shared_put(x.s, "k\xff", value) == value);
+    unit_assert(T, trie_shared_get(x.s, "k\xff") == value);
+    unit_assert(T, trie_shared_get(x.s, "k") == NULL);
+    trie_shared_destroy(x.s);
+}
+
+void test_put_get_bytes(T_t *T, void *t)
+{
+    const char *values[] = {"v0", "v1", "v2", "v3"};
+    unit_assert(T, trie_put(t, "a", values[0]) == values[0]);
+    unit_assert(T, trie_put_bytes(t, "a\0", 2, values[1]) == values[1]);
+    unit_assert(T, trie_put_bytes(t, "a\0b", 3, values[2]) == values[2]);
+    unit_assert(T, trie_put_bytes(t, "\0", 1, values[3]) == values[3]);
+    unit_assert(T, trie_put_bytes(t, "", 0, values[0]) == NULL);
+
+    // Keys are read from within a buffer, without being copied.
+    const char buffer[] = "xa\0bx";
+    unit_assert(T, trie_get_bytes(t, &buffer[1], 1) == values[0]);
+    unit_assert(T, trie_get_bytes(t, &buffer[1], 2) == values[1]);
+    unit_assert(T, trie_get_bytes(t, &buffer[1], 3) == values[2]);
+    unit_assert(T, trie_get_bytes(t, &buffer[1], 4) == NULL);
+    unit_assert(T, trie_get_bytes(t, &buffer[2], 1) == values[3]);
+    unit_assert(T, trie_get_bytes(t, buffer, 0) == NULL);
+    unit_assert(T, trie_get(t, "a") == values[0]);
+    unit_assert(T, trie_get(t, "") == NULL);
+
+    size_t size;
+    char *suggestion = trie_suggest_bytes(t, "a\0b\0", 5, &size);
+    unit_assert(T, suggestion != NULL);
+    unit_assert(T, size == 3 && memcmp(suggestion, "a\0b", 4) == 0);
+    free(suggestion);
+    assert_trie_suggest(T, t, "a", "a");
+
+    // Cursors yield keys with zeros in order, along with their lengths.
+    char key[8];
+    const void *value;
+    trie_cursor_t c;
+    unit_assert(T, trie_cursor_init(&c, t, "a", key, sizeof(key)) == 0);
+    unit_assert(T, trie_cursor_next(&c, &value) == 1);
+    unit_assert(T, c.length == 1 && value == values[0]);
+    unit_assert(T, trie_cursor_next(&c, &value) == 1);
+    unit_assert(T, c.length == 2 && value == values[1]);
+    unit_assert(T, trie_cursor_next(&c, &value) == 1);
+    unit_assert(T, c.length == 3 && memcmp(key, "a\0b", 4) == 0);
+    unit_assert(T, trie_cursor_next(&c, &value) == 0);
+
+    // Packed and frozen TRIEs leave keys with zeros out.
+    trie_frozen_t *f = trie_freeze(t);
+    unit_assert(T, f != NULL);
+    unit_assert(T, trie_frozen_get(f, "a") == values[0]);
+    trie_frozen_destroy(f);
+    trie_packed_t *p = trie_pack(t);
+    unit_assert(T, p != NULL);
+    unit_assert(T, trie_packed_get(p, "a") == values[0]);
+    trie_packed_destroy(p);
+}
+
+void test_get_batch(T_t *T, void *t)
+{
+    // More keys than are looked up at once, of which some are missing.
+    static char keys[1000][16];
+    const char *batch[1003];
+    const void *out[1003];
+    for (unsigned i = 0; i < 1000; ++i) {
+        make_key(keys[i], i);
+        if (i % 3 != 0) {
+            trie_put(t, keys[i], keys[i]);
+        }
+        batch[i] = keys[i];
+    }
+    batch[1000] = "";
+    batch[1001] = keys[1];
+    batch[1002] = "";
+    trie_get_batch(t, batch, 1003, out);
+    for (unsigned i = 0; i < 1003; ++i) {
+        if (out[i] != trie_get(t, batch[i])) {
+            unit_failf(T, "out[%u] != trie_get(t, \"%s\")", i, batch[i]);
+        }
+    }
+    unit_assert(T, out[1] == keys[1] && out[1001] == keys[1]);
+
+    trie_get_batch(t, batch, 0, out);
+    trie_get_batch(t, &batch[1000], 1, out);
+    unit_assert(T, out[0] == NULL);
+}
+
+void test_remove(T_t *T, void *t)
+{
+    const char *values[] = {"v0", "v1", "v2"};
+    trie_put(t, "moon", values[0]);
+    trie_put(t, "moo", values[1]);
+    trie_put(t, "monkey", values[2]);
+    unit_assert(T, trie_remove(t, "mo") == NULL);
+    unit_assert(T, trie_remove(t, "moonlight") == NULL);
+    unit_assert(T, trie_remove(t, "") == NULL);
+
+    unit_assert(T, trie_remove(t, "moo") == values[1]);
+    unit_assert(T, trie_remove(t, "moo") == NULL);
+    unit_assert(T, trie_get(t, "moo") == NULL);
+    unit_assert(T, trie_get(t, "moon") == values[0]);
+    unit_assert(T, trie_remove(t, "monkey") == values[2]);
+    unit_assert(T, trie_get(t, "moon") == values[0]);
+    assert_trie_suggest(T, t, "mon", "moon");
+
+    // Nodes of removed keys are reused.
+    const unsigned amount = ((trie_t *) t)->amount;
+    trie_put(t, "monkey", values[2]);
+    unit_assert(T, ((trie_t *) t)->amount == amount);
+    unit_assert(T, trie_get(t, "monkey") == values[2]);
+
+    unit_assert(T, trie_remove(t, "moon") == values[0]);
+    unit_assert(T, trie_remove(t, "monkey") == values[2]);
+    unit_assert(T, trie_get(t, "m") == NULL);
+    unit_assert(T, trie_put(t, "b", values[1]) == values[1]);
+    unit_assert(T, trie_get(t, "b") == values[1]);
+
+    // Values of removed keys need not be in the blob of a saved image.
+    const char blob[] = "blob";
+    const char *path = "trie.unit.img";
+    trie_put(t, "cow", values[0]);
+    unit_assert(T, trie_remove(t, "cow") == values[0]);
+    unit_assert(T, trie_remove(t, "b") == values[1]);
+    unit_assert(T, trie_save(t, path, blob, sizeof(blob)) == 0);
+    remove(path);
+}
+
+void test_compact(T_t *T, void *t)
+{
+    // Every third key stays, and the rest are removed and put again.
+    static char keys[1000][16];
+    for (unsigned i = 0; i < 1000; ++i) {
+        snprintf(keys[i], sizeof(keys[i]), "%c%u", '!' + i % 90, i);
+        trie_put(t, keys[i], keys[i]);
+    }
+    for (unsigned i = 0; i < 1000; ++i) {
+        if (i % 3 != 0) {
+            trie_remove(t, keys[i]);
+        }
+    }
+    const unsigned amount = ((trie_t *) t)->amount;
+    unit_assert(T, trie_compact(t) == 0);
+    unit_assert(T, ((trie_t *) t)->amount < amount / 2);
+    unit_assert(T, ((trie_t *) t)->limit == ((trie_t *) t)->amount);
+    for (unsigned i = 0; i < 1000; ++i) {
+        const void *expected = i % 3 == 0 ? keys[i] : NULL;
+        if (trie_get(t, keys[i]) != expected) {
+            unit_failf(T, "trie_get(t, \"%s\") != %p", keys[i], expected);
+        }
+    }
+    for (unsigned i = 0; i < 1000; ++i) {
+        trie_put(t, keys[i], keys[i]);
+    }
+    unit_assert(T, ((trie_t *) t)->amount <= amount);
+    for (unsigned i = 0; i < 1000; ++i) {
+        trie_remove(t, keys[i]);
+    }
+    unit_assert(T, trie_compact(t) == 0);
+    unit_assert(T, ((trie_t *) t)->amount == 1);
+    unit_assert(T, trie_put(t, "dog", keys[0]) == keys[0]);
+    unit_assert(T, trie_get(t, "dog") == keys[0]);
+}
+
 void provider_trie(T_t *T, unit_test_t test)
 {
     trie_t *t = trie_create(2);